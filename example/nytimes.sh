@@ -10,11 +10,10 @@ cd $dir
 
 # 1. Download the data
 # wget https://archive.ics.uci.edu/ml/machine-learning-databases/bag-of-words/docword.nytimes.txt.gz
-# gunzip $dir/docword.nytimes.txt.gz
 # wget https://archive.ics.uci.edu/ml/machine-learning-databases/bag-of-words/vocab.nytimes.txt
 
 # 2. UCI format to libsvm format
-# python $root/example/text2libsvm.py $dir/docword.nytimes.txt $dir/vocab.nytimes.txt $dir/nytimes.libsvm $dir/nytimes.word_id.dict
+# $bin/corpus_stats $dir/docword.nytimes.txt.gz $dir/nytimes.word_id.dict -format uci -vocab $dir/vocab.nytimes.txt -libsvm_output $dir/nytimes.libsvm
 
 # 3. libsvm format to binary format
 # $bin/dump_binary $dir/nytimes.libsvm $dir/nytimes.word_id.dict $dir 0
@@ -10,11 +10,10 @@ cd $dir
 
 # 1. Download the data
 wget https://archive.ics.uci.edu/ml/machine-learning-databases/bag-of-words/docword.pubmed.txt.gz
-gunzip $dir/docword.pubmed.txt.gz
 wget https://archive.ics.uci.edu/ml/machine-learning-databases/bag-of-words/vocab.pubmed.txt
 
 # 2. UCI format to libsvm format
-python $root/text2libsvm.py $dir/docword.pubmed.txt $dir/vocab.pubmed.txt $dir/pubmed.libsvm $dir/pubmed.word_id.dict
+$bin/corpus_stats $dir/docword.pubmed.txt.gz $dir/pubmed.word_id.dict -format uci -vocab $dir/vocab.pubmed.txt -libsvm_output $dir/pubmed.libsvm
 
 # 3. libsvm format to binary format
 $bin/dump_binary $dir/pubmed.libsvm $dir/pubmed.word_id.dict $dir 0
@@ -4,6 +4,7 @@
 #include "data_block.h"
 #include "document.h"
 #include "meta.h"
+#include "scheduler.h"
 #include "util.h"
 #include "model.h"
 #include "inferer.h"
@@ -25,23 +26,25 @@ namespace multiverso { namespace lightlda
             //init meta
             meta.Init();
             //init model
-            LocalModel* model = new LocalModel(&meta); model->Init();
+            CompactModel* model = new CompactModel(&meta); model->Init();
             //init document stream
-            data_stream = CreateDataStream();
+            data_stream = CreateDataStream(Config::num_iterations);
             //init documents
             InitDocument();
-            //init alias table
+            //init alias table, with rows laid out by the model
+            Config::alias_capacity = AliasTable::Capacity(&meta, model);
             AliasTable* alias_table = new AliasTable();
             //init inferers
             std::vector<Inferer*> inferers;
             Barrier barrier(Config::num_local_workers);
+            DocScheduler scheduler(Config::num_local_workers);
             // pthread_barrier_t barrier;
             // pthread_barrier_init(&barrier, nullptr, Config::num_local_workers);
             for (int32_t i = 0; i < Config::num_local_workers; ++i)
             {
                inferers.push_back(new Inferer(alias_table, data_stream, 
                     &meta, model, 
-                    &barrier, i, Config::num_local_workers));
+                    &barrier, &scheduler, i, Config::num_local_workers));
             }
 
             //do inference in muti-threads
@@ -114,16 +117,16 @@ namespace multiverso { namespace lightlda
                 {
                     for (int32_t i = 0; i < data_block.Size(); ++i)
                     {
-                        Document* doc = data_block.GetOneDoc(i);
-                        int32_t& cursor = doc->Cursor();
+                        Document doc = data_block.GetOneDoc(i);
+                        int32_t& cursor = doc.Cursor();
                         if (slice == 0) cursor = 0;
                         int32_t last_word = meta.local_vocab(block).LastWord(slice);
-                        for (; cursor < doc->Size(); ++cursor)
+                        for (; cursor < doc.Size(); ++cursor)
                         {
-                            if (doc->Word(cursor) > last_word) break;
+                            if (doc.Word(cursor) > last_word) break;
                             // Init the latent variable
                             if (!Config::warm_start)
-                                doc->SetTopic(cursor, rng.rand_k(Config::num_topics));
+                                doc.SetTopic(cursor, rng.rand_k(Config::num_topics));
                         }
                     }
                 }
@@ -142,9 +145,9 @@ namespace multiverso { namespace lightlda
                 DataBlock& data_block = data_stream->CurrDataBlock();
                 for (int i = 0; i < data_block.Size(); ++i)
                 {
-                    Document* doc = data_block.GetOneDoc(i);
+                    Document doc = data_block.GetOneDoc(i);
                     doc_topic_counter.Clear();
-                    doc->GetDocTopicVector(doc_topic_counter);
+                    doc.GetDocTopicVector(doc_topic_counter);
                     fout << i << " ";  // doc id
                     Row<int32_t>::iterator iter = doc_topic_counter.Iterator();
                     while (iter.HasNext())
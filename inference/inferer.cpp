@@ -5,6 +5,7 @@
 #include "data_block.h"
 #include "meta.h"
 #include "sampler.h"
+#include "scheduler.h"
 #include "model.h"
 #include "data_stream.h"
 #include <multiverso/stop_watch.h>
@@ -15,12 +16,12 @@ namespace multiverso { namespace lightlda
 {
     Inferer::Inferer(AliasTable* alias_table,
         IDataStream * data_stream,
-        Meta* meta, LocalModel * model,
-        Barrier* barrier, 
+        Meta* meta, CompactModel * model,
+        Barrier* barrier, DocScheduler* scheduler,
         int32_t id, int32_t thread_num):
         alias_(alias_table), data_stream_(data_stream),
         meta_(meta), model_(model),
-        barrier_(barrier), 
+        barrier_(barrier), scheduler_(scheduler),
         id_(id), thread_num_(thread_num) 
     {
         sampler_ = new LightDocSampler();
@@ -40,7 +41,9 @@ namespace multiverso { namespace lightlda
             DataBlock& data = data_stream_->CurrDataBlock();
             data.set_meta(&(meta_->local_vocab(block)));
             alias_->Init(meta_->alias_index(block, 0));
+            alias_->Plan(data.meta().begin(0), data.meta().end(0), model_);
             alias_->Build(-1, model_);
+            scheduler_->Init(data);
 	}
         barrier_->Wait();
 
@@ -70,12 +73,30 @@ namespace multiverso { namespace lightlda
 	DataBlock& data = data_stream_->CurrDataBlock();
         const LocalVocab& local_vocab = data.meta();
         int32_t lastword = local_vocab.LastWord(0);
-        // Inference with lightlda sampler
-        for (int32_t doc_id = id_; doc_id < data.Size(); doc_id += thread_num_)
+        StopWatch watch; watch.Start();
+        int64_t num_token = 0;
+        // Inference with lightlda sampler, documents are taken chunk by chunk
+        int32_t doc_begin = 0, doc_end = 0;
+        while (scheduler_->Next(id_, &doc_begin, &doc_end))
+        {
+            for (int32_t doc_id = doc_begin; doc_id < doc_end; ++doc_id)
+            {
+                Document doc = data.GetOneDoc(doc_id);
+                num_token += sampler_->SampleOneDoc(&doc, 0, lastword, 
+                    model_, alias_);
+            }
+        }
+        double busy_seconds = watch.ElapsedSeconds();
+        scheduler_->Record(id_, busy_seconds);
+        barrier_->Wait();
+        if (id_ == 0)
         {
-            Document* doc = data.GetOneDoc(doc_id);
-            sampler_->SampleOneDoc(doc, 0, lastword, model_, alias_);
+            Log::Info("iter=%d, sampling throughput: %.6f (tokens/thread/sec) \n",
+                iter, num_token / (busy_seconds > 0 ? busy_seconds : 1e-9));
+            scheduler_->Report();
+            scheduler_->Reset();
         }
+        barrier_->Wait();
     }
 
     void Inferer::EndIteration()
@@ -17,10 +17,11 @@ namespace multiverso
 namespace lightlda
 {
     class AliasTable;
+    class DocScheduler;
     class LDADataBlock;
     class LightDocSampler;
     class Meta;
-    class LocalModel;
+    class CompactModel;
     class IDataStream;
     
     class Inferer
@@ -28,8 +29,8 @@ namespace lightlda
     public:
         Inferer(AliasTable* alias_table, 
                 IDataStream * data_stream,
-                Meta* meta, LocalModel * model,
-                Barrier* barrier, 
+                Meta* meta, CompactModel * model,
+                Barrier* barrier, DocScheduler* scheduler,
                 int32_t id, int32_t thread_num);
 
         ~Inferer();
@@ -40,8 +41,9 @@ namespace lightlda
         AliasTable* alias_;
         IDataStream * data_stream_;
         Meta* meta_;
-        LocalModel * model_;
+        CompactModel * model_;
         Barrier* barrier_;
+        DocScheduler* scheduler_;
         int32_t id_;
         int32_t thread_num_;
         LightDocSampler* sampler_;
@@ -0,0 +1,112 @@
+/*!
+ * \file block_format.h
+ * \brief Headers of the block, vocab and model files for the preprocessing
+ *  tools, from src/file_format.h which training and inference read them with
+ */
+
+#ifndef LIGHTLDA_BLOCK_FORMAT_H_
+#define LIGHTLDA_BLOCK_FORMAT_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "../src/file_format.h"
+
+namespace lightlda
+{
+    /*
+     * Block file of version 1:
+     * header, the documents (int32 * corpus_size), the doc offsets
+     * (int64 * (doc_num + 1)). The header is written last, at the start of
+     * the file, until then its magic is kIncompleteMagic.
+     * legacy:       doc number(int64), doc offsets, the documents
+     *
+     * Vocab file of version 1:
+     * header, words, global tf, local tf(int32 * size)
+     * legacy:       size(int32), words, global tf, local tf(int32 * size)
+     *
+     * Model file: header, see ModelFileHeader
+     */
+    using multiverso::lightlda::kBlockHeaderMagic;
+    using multiverso::lightlda::kVocabHeaderMagic;
+    using multiverso::lightlda::kModelMagic;
+    using multiverso::lightlda::kIncompleteMagic;
+    using multiverso::lightlda::kFormatVersion;
+    using multiverso::lightlda::kByteOrderMark;
+    using multiverso::lightlda::kInterleavedLayout;
+    using multiverso::lightlda::kRunLengthLayout;
+    using multiverso::lightlda::kDocLengthBins;
+
+    typedef multiverso::lightlda::BlockHeader block_file_header;
+    typedef multiverso::lightlda::VocabHeader vocab_file_header;
+    typedef multiverso::lightlda::ModelFileHeader model_file_header;
+
+    inline block_file_header new_block_header(int32_t layout)
+    {
+        block_file_header header;
+        memset(&header, 0, sizeof(header));
+        header.magic = kBlockHeaderMagic;
+        header.version = kFormatVersion;
+        header.byte_order = kByteOrderMark;
+        header.layout = layout;
+        return header;
+    }
+
+    inline vocab_file_header new_vocab_header(int32_t size, int32_t max_word,
+        int64_t token_num)
+    {
+        vocab_file_header header;
+        header.magic = kVocabHeaderMagic;
+        header.version = kFormatVersion;
+        header.byte_order = kByteOrderMark;
+        header.size = size;
+        header.max_word = max_word;
+        header.token_num = token_num;
+        return header;
+    }
+
+    /*! \brief counts a doc of doc_length tokens taking size int32 */
+    inline void add_doc(block_file_header& header, int64_t doc_length, int64_t size)
+    {
+        int32_t bin = 0;
+        while (bin + 1 < kDocLengthBins && (1LL << bin) <= doc_length) ++bin;
+        ++header.doc_length_histogram[bin];
+        ++header.doc_num;
+        header.token_num += doc_length;
+        header.corpus_size += size;
+        if (doc_length > header.max_doc_length) header.max_doc_length = doc_length;
+    }
+
+    /*!
+     * \brief moves a complete file written as temp_name to file_name, so
+     *  readers never see a partial file_name
+     */
+    inline bool move_file(const std::string& temp_name, const std::string& file_name)
+    {
+#ifdef _MSC_VER
+        // rename does not replace an existing file on Windows
+        std::remove(file_name.c_str());
+#endif
+        return std::rename(temp_name.c_str(), file_name.c_str()) == 0;
+    }
+
+    /*! \brief adds the docs of other after the docs of header */
+    inline void merge_header(block_file_header& header, const block_file_header& other)
+    {
+        for (int32_t i = 0; i < kDocLengthBins; ++i)
+        {
+            header.doc_length_histogram[i] += other.doc_length_histogram[i];
+        }
+        header.doc_num += other.doc_num;
+        header.token_num += other.token_num;
+        header.corpus_size += other.corpus_size;
+        if (other.max_doc_length > header.max_doc_length)
+        {
+            header.max_doc_length = other.max_doc_length;
+        }
+    }
+}
+
+#endif // LIGHTLDA_BLOCK_FORMAT_H_
@@ -0,0 +1,485 @@
+/*!
+ * \file convert_model.cpp
+ * \brief Preprocessing tool for converting the text model files dumped by
+ *  the servers, server_*_table_0.model for the word-topic table and
+ *  server_*_table_1.model for the summary row, into one binary model file,
+ *  which LightLDA inference maps from input_dir/model.bin without parsing
+ *  Usage:
+ *    convert_model <model_dir> <num_topics> <binary_model_output> [options]
+ *  Options:
+ *    -num_threads <arg> Number of threads, each parsing a model file. Default: 4
+ *    -prune <arg>       Drops the entries of a row with count below this ratio
+ *                       of the row total. Default: 0, no pruning
+ *    -quantize <arg>    Divides the counts by this factor, rounded, entries
+ *                       rounded to 0 are dropped. Default: 1
+ *  The summary row is summed from the rows written when pruned or quantized
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <Windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "block_format.h"
+#include "libsvm_tokenizer.h"
+#include "parallel_for.h"
+#include "utf8_stream.h"
+
+namespace lightlda
+{
+    /*
+     * Output file format, see ModelFileHeader in src/file_format.h:
+     * the header, the row offsets (int64 * (num_words + 1)),
+     * the topics and the counts of the non-zero entries (int32 * nnz each)
+     * and the summary row (int64 * num_topics). Row w holds entries
+     * [offsets[w], offsets[w + 1]) with topics in ascending order.
+     *
+     * A line of a text model file is "word_id topic:count topic:count ...".
+     * Each thread parses whole files, the rows are put in word order when
+     * written. All entries are held in memory, 12 bytes per entry.
+     */
+
+    // should be the same as kWordTopicTable and kSummaryRow in src/common.h
+    const int32_t kWordTopicTable = 0;
+    const int32_t kSummaryRow = 1;
+
+    /*! \brief entries of a row, in the buffers of the file it is parsed from */
+    struct row_ref
+    {
+        int32_t part;
+        int32_t size;
+        int64_t begin;
+    };
+
+    /*! \brief the rows parsed from a text model file */
+    struct model_part
+    {
+        std::string file_name;
+        std::vector<int32_t> words;
+        std::vector<row_ref> rows;
+        std::vector<int32_t> topics;
+        std::vector<int64_t> counts;
+    };
+
+    /*! \brief lists the text model files of a table in a directory */
+    std::vector<std::string> list_model_files(const std::string& dir, int32_t table)
+    {
+        std::string suffix = "_table_" + std::to_string(table) + ".model";
+        std::vector<std::string> names;
+#ifdef _MSC_VER
+        WIN32_FIND_DATAA data;
+        HANDLE handle = FindFirstFileA((dir + "\\server_*" + suffix).c_str(), &data);
+        if (handle != INVALID_HANDLE_VALUE)
+        {
+            do
+            {
+                names.push_back(data.cFileName);
+            } while (FindNextFileA(handle, &data));
+            FindClose(handle);
+        }
+#else
+        DIR* d = opendir(dir.c_str());
+        if (d == nullptr)
+        {
+            std::cout << "Fails to open directory: " << dir << std::endl;
+            exit(1);
+        }
+        while (struct dirent* ent = readdir(d))
+        {
+            names.push_back(ent->d_name);
+        }
+        closedir(d);
+#endif
+        std::vector<std::string> files;
+        for (auto& name : names)
+        {
+            // server_<digits>_table_<table>.model
+            if (name.size() <= 7 + suffix.size() || name.compare(0, 7, "server_") != 0 ||
+                name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+            {
+                continue;
+            }
+            std::string server = name.substr(7, name.size() - 7 - suffix.size());
+            if (server.find_first_not_of("0123456789") == std::string::npos)
+            {
+                files.push_back(dir + "/" + name);
+            }
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    inline void skip_spaces(const char*& ptr, const char* end)
+    {
+        while (ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\r')) ++ptr;
+    }
+
+    /*!
+     * \brief parses an optionally negative decimal number at ptr, in int64
+     *  as the counts of the summary row can exceed int32
+     */
+    inline bool parse_int(const char*& ptr, const char* end, int64_t& value)
+    {
+        bool negative = (ptr < end && *ptr == '-');
+        if (negative) ++ptr;
+        const char* begin = ptr;
+        value = 0;
+        while (ptr < end && *ptr >= '0' && *ptr <= '9' && ptr - begin < 18)
+        {
+            value = value * 10 + (*ptr - '0');
+            ++ptr;
+        }
+        if (negative) value = -value;
+        return ptr != begin && (ptr == end || *ptr < '0' || *ptr > '9');
+    }
+
+    /*!
+     * \brief parses the rows of a text model file, each line
+     *  "word_id topic:count ...". The counts of a topic repeated in a line
+     *  are summed, zero counts are dropped
+     */
+    void parse_model_file(int32_t part_id, int32_t num_topics, model_part& part)
+    {
+        utf8_stream stream(1024 * 1024 * 64);
+        if (!stream.open(part.file_name))
+        {
+            std::cout << "Fails to open file: " << part.file_name << std::endl;
+            exit(1);
+        }
+        const char* line_begin = nullptr;
+        const char* line_end = nullptr;
+        std::vector<std::pair<int32_t, int64_t>> entries;
+        while (stream.getline(line_begin, line_end))
+        {
+            const char* ptr = line_begin;
+            skip_spaces(ptr, line_end);
+            if (ptr == line_end)
+            {
+                continue;
+            }
+            int32_t word;
+            if (!parse_uint(ptr, line_end, word))
+            {
+                std::cout << "Bad format of model: "
+                    << std::string(line_begin, line_end) << std::endl;
+                exit(1);
+            }
+            entries.clear();
+            skip_spaces(ptr, line_end);
+            while (ptr < line_end)
+            {
+                int32_t topic;
+                int64_t count;
+                if (!parse_uint(ptr, line_end, topic) || ptr == line_end ||
+                    *ptr++ != ':' || !parse_int(ptr, line_end, count) ||
+                    topic >= num_topics)
+                {
+                    std::cout << "Bad format of model: "
+                        << std::string(line_begin, line_end) << std::endl;
+                    exit(1);
+                }
+                entries.push_back(std::make_pair(topic, count));
+                skip_spaces(ptr, line_end);
+            }
+            std::sort(entries.begin(), entries.end());
+            int64_t begin = static_cast<int64_t>(part.topics.size());
+            for (size_t i = 0; i < entries.size();)
+            {
+                int32_t topic = entries[i].first;
+                int64_t count = 0;
+                for (; i < entries.size() && entries[i].first == topic; ++i)
+                {
+                    count += entries[i].second;
+                }
+                if (count != 0)
+                {
+                    part.topics.push_back(topic);
+                    part.counts.push_back(count);
+                }
+            }
+            part.words.push_back(word);
+            part.rows.push_back({ part_id, 
+                static_cast<int32_t>(part.topics.size() - begin), begin });
+        }
+        stream.close();
+    }
+
+    /*!
+     * \brief drops the entries of rows with count below prune * row total,
+     *  divides the others by quantize, rounded, and drops those rounded to
+     *  0. Rows keep their place in the buffers of the part
+     */
+    void prune_rows(model_part& part, double prune, int64_t quantize)
+    {
+        for (auto& row : part.rows)
+        {
+            int64_t total = 0;
+            for (int64_t i = row.begin; i < row.begin + row.size; ++i)
+            {
+                total += part.counts[i];
+            }
+            int32_t size = 0;
+            for (int64_t i = row.begin; i < row.begin + row.size; ++i)
+            {
+                int64_t count = part.counts[i];
+                if (prune > 0 && count < prune * total)
+                {
+                    continue;
+                }
+                count = (count >= 0) ? (count + quantize / 2) / quantize :
+                    -((quantize / 2 - count) / quantize);
+                if (count != 0)
+                {
+                    part.topics[row.begin + size] = part.topics[i];
+                    part.counts[row.begin + size] = count;
+                    ++size;
+                }
+            }
+            row.size = size;
+        }
+    }
+
+    /*! \brief sums the counts of the rows by topic, and the entries and counts */
+    std::vector<int64_t> sum_rows(const std::vector<model_part>& parts,
+        int32_t num_topics, int64_t& num_entries, int64_t& mass)
+    {
+        std::vector<int64_t> summary(num_topics, 0);
+        num_entries = 0;
+        mass = 0;
+        for (auto& part : parts)
+        {
+            for (auto& row : part.rows)
+            {
+                for (int64_t i = row.begin; i < row.begin + row.size; ++i)
+                {
+                    summary[part.topics[i]] += part.counts[i];
+                    mass += part.counts[i];
+                }
+                num_entries += row.size;
+            }
+        }
+        return summary;
+    }
+
+    void write_model(const std::string& file_name, int32_t num_topics,
+        const std::vector<model_part>& parts, const std::vector<int64_t>& summary)
+    {
+        int32_t num_words = 0;
+        for (auto& part : parts)
+        {
+            for (auto word : part.words)
+            {
+                num_words = std::max(num_words, word + 1);
+            }
+        }
+        std::vector<row_ref> rows(num_words, { -1, 0, 0 });
+        for (auto& part : parts)
+        {
+            for (size_t i = 0; i < part.words.size(); ++i)
+            {
+                if (rows[part.words[i]].part != -1)
+                {
+                    std::cout << "Duplicate rows of word " << part.words[i]
+                        << " in " << part.file_name << std::endl;
+                    exit(1);
+                }
+                rows[part.words[i]] = part.rows[i];
+            }
+        }
+
+        model_file_header header;
+        header.magic = kModelMagic;
+        header.version = kFormatVersion;
+        header.byte_order = kByteOrderMark;
+        header.num_words = num_words;
+        header.num_topics = num_topics;
+        std::vector<int64_t> offsets(num_words + 1, 0);
+        for (int32_t word = 0; word < num_words; ++word)
+        {
+            offsets[word + 1] = offsets[word] + rows[word].size;
+        }
+        header.nnz = offsets[num_words];
+
+        // written under a temporary name, inference maps file_name
+        std::string temp_name = file_name + ".temp";
+        std::ofstream stream(temp_name, std::ios::out | std::ios::binary);
+        if (!stream.good())
+        {
+            std::cout << "Fails to create file: " << temp_name << std::endl;
+            exit(1);
+        }
+        stream.write(reinterpret_cast<char*>(&header), sizeof(header));
+        stream.write(reinterpret_cast<char*>(offsets.data()),
+            sizeof(int64_t)* offsets.size());
+        for (int32_t word = 0; word < num_words; ++word)
+        {
+            const row_ref& row = rows[word];
+            if (row.size > 0)
+            {
+                stream.write(reinterpret_cast<const char*>(
+                    parts[row.part].topics.data() + row.begin), sizeof(int32_t)* row.size);
+            }
+        }
+        std::vector<int32_t> counts;
+        for (int32_t word = 0; word < num_words; ++word)
+        {
+            const row_ref& row = rows[word];
+            counts.clear();
+            for (int64_t i = row.begin; i < row.begin + row.size; ++i)
+            {
+                int64_t count = parts[row.part].counts[i];
+                if (count > INT32_MAX || count < INT32_MIN)
+                {
+                    std::cout << "Count out of int32 of word " << word << std::endl;
+                    exit(1);
+                }
+                counts.push_back(static_cast<int32_t>(count));
+            }
+            stream.write(reinterpret_cast<char*>(counts.data()),
+                sizeof(int32_t)* counts.size());
+        }
+        stream.write(reinterpret_cast<const char*>(summary.data()),
+            sizeof(int64_t)* num_topics);
+        stream.close();
+        if (!stream.good() || !move_file(temp_name, file_name))
+        {
+            std::cout << "Fails to write file: " << file_name << std::endl;
+            exit(1);
+        }
+        std::cout << "Wrote " << num_words << " words, " << header.nnz
+            << " entries to " << file_name << std::endl;
+    }
+}
+
+double get_time()
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    auto since_epoch = start.time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::duration<double, std::ratio<1, 1>>>(since_epoch).count();
+}
+
+void print_usage()
+{
+    printf("Usage:\n");
+    printf("  convert_model <model_dir> <num_topics> <binary_model_output> [options]\n");
+    printf("Options:\n");
+    printf("  -num_threads <arg> Number of threads, each parsing a model file. Default: 4\n");
+    printf("  -prune <arg>       Drops the entries of a row with count below this ratio\n");
+    printf("                     of the row total. Default: 0, no pruning\n");
+    printf("  -quantize <arg>    Divides the counts by this factor, rounded, entries\n");
+    printf("                     rounded to 0 are dropped. Default: 1\n");
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        print_usage();
+        exit(1);
+    }
+    std::string model_dir = argv[1];
+    int32_t num_topics = atoi(argv[2]);
+    std::string output_name = argv[3];
+    int32_t num_threads = 4;
+    double prune = 0;
+    int64_t quantize = 1;
+    for (int32_t i = 4; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-num_threads") == 0 && i + 1 < argc)
+        {
+            num_threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-prune") == 0 && i + 1 < argc)
+        {
+            prune = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-quantize") == 0 && i + 1 < argc)
+        {
+            quantize = atoll(argv[++i]);
+        }
+        else
+        {
+            print_usage();
+            exit(1);
+        }
+    }
+    if (num_topics <= 0 || num_threads <= 0 || prune < 0 || prune >= 1 ||
+        quantize <= 0)
+    {
+        print_usage();
+        exit(1);
+    }
+
+    double start = get_time();
+    std::vector<std::string> word_topic_files =
+        lightlda::list_model_files(model_dir, lightlda::kWordTopicTable);
+    std::vector<std::string> summary_files =
+        lightlda::list_model_files(model_dir, lightlda::kSummaryRow);
+    if (word_topic_files.empty() || summary_files.empty())
+    {
+        std::cout << "No model files in " << model_dir << std::endl;
+        exit(1);
+    }
+
+    // the summary row is row 0 of the summary table
+    std::vector<lightlda::model_part> parts(word_topic_files.size() + summary_files.size());
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        parts[i].file_name = (i < word_topic_files.size()) ?
+            word_topic_files[i] : summary_files[i - word_topic_files.size()];
+    }
+    lightlda::parallel_for(static_cast<int32_t>(parts.size()), num_threads, [&](int32_t i)
+    {
+        lightlda::parse_model_file(i, num_topics, parts[i]);
+    });
+
+    std::vector<int64_t> summary(num_topics, 0);
+    for (size_t i = word_topic_files.size(); i < parts.size(); ++i)
+    {
+        const lightlda::model_part& part = parts[i];
+        for (size_t r = 0; r < part.words.size(); ++r)
+        {
+            if (part.words[r] != 0)
+            {
+                continue;
+            }
+            for (int64_t j = part.rows[r].begin; j < part.rows[r].begin + part.rows[r].size; ++j)
+            {
+                summary[part.topics[j]] += part.counts[j];
+            }
+        }
+    }
+    parts.resize(word_topic_files.size());
+    if (prune > 0 || quantize > 1)
+    {
+        int64_t num_entries = 0, mass = 0;
+        lightlda::sum_rows(parts, num_topics, num_entries, mass);
+        lightlda::parallel_for(static_cast<int32_t>(parts.size()), num_threads, [&](int32_t i)
+        {
+            lightlda::prune_rows(parts[i], prune, quantize);
+        });
+        // the summary row should be the sum of the rows inference samples
+        int64_t kept_entries = 0, kept_mass = 0;
+        summary = lightlda::sum_rows(parts, num_topics, kept_entries, kept_mass);
+        std::cout << "Kept " << kept_entries << " of " << num_entries
+            << " entries (" << 100.0 * kept_entries / std::max<int64_t>(num_entries, 1)
+            << "%), " << 100.0 * kept_mass * quantize / std::max<int64_t>(mass, 1)
+            << "% of the count mass, entries take "
+            << (8.0 * kept_entries) / 1024 / 1024 << " MB instead of "
+            << (8.0 * num_entries) / 1024 / 1024 << " MB" << std::endl;
+    }
+    lightlda::write_model(output_name, num_topics, parts, summary);
+    std::cout << "Elapsed seconds for converting model: " << get_time() - start << std::endl;
+    return 0;
+}
@@ -0,0 +1,399 @@
+/*!
+ * \file corpus_stats.cpp
+ * \brief Preprocessing tool for counting the global term frequency of a
+ *  corpus, writing the word dict file used by dump_binary. It replaces
+ *  example/get_meta.py, and example/text2libsvm.py for UCI input.
+ *  Usage:
+ *    corpus_stats <input> <word_dict_file_output> [options]
+ *    input "-" reads the standard input, .gz and .zst files are read through
+ *    gzip or zstd, both with one thread
+ *  Options:
+ *    -format <arg>        Input format, libsvm or uci. Default: libsvm
+ *    -vocab <arg>         Vocab file with a word per line, for the word
+ *                         column of the dict. Default: "word" for all
+ *    -libsvm_output <arg> Write the UCI input in libsvm format
+ *    -num_threads <arg>   Number of threads. Default: 1
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "libsvm_tokenizer.h"
+#include "parallel_for.h"
+#include "utf8_stream.h"
+
+namespace lightlda
+{
+    /*
+     * UCI bag-of-words docword format: three header lines with the number
+     * of docs, words and non-zeros, then a "doc_id word_id count" line
+     * for each non-zero, grouped by doc. Word ids start from 1 and are
+     * shifted to start from 0, as text2libsvm.py does.
+     *
+     * Each thread counts a byte range of the input into its own dense tf
+     * array indexed by word id, the arrays are summed at the end.
+     */
+
+    /*! \brief a byte range of the input and its counts */
+    struct range_stats
+    {
+        int64_t begin;
+        int64_t end;
+        int64_t bytes = 0;
+        int64_t doc_num = 0;
+        int64_t token_num = 0;
+        std::vector<int64_t> tf;
+    };
+
+    inline void add_tf(std::vector<int64_t>& tf, int32_t word, int32_t count)
+    {
+        if (word >= tf.size())
+        {
+            tf.resize(std::max<size_t>(word + 1, tf.size() * 2), 0);
+        }
+        tf[word] += count;
+    }
+
+    /*! \brief parses "doc_id word_id count", false if not such a line */
+    inline bool parse_docword(const char* ptr, const char* end,
+        int32_t& doc, int32_t& word, int32_t& count)
+    {
+        if (!parse_uint(ptr, end, doc) || ptr == end || *ptr != ' ') return false;
+        ++ptr;
+        if (!parse_uint(ptr, end, word) || ptr == end || *ptr != ' ') return false;
+        ++ptr;
+        if (!parse_uint(ptr, end, count)) return false;
+        while (ptr < end && (*ptr == ' ' || *ptr == '\r')) ++ptr;
+        return ptr == end && word > 0;
+    }
+
+    /*! \brief doc id of the docword line starting at pos, -1 if none */
+    int32_t docword_doc_at(std::ifstream& stream, int64_t pos, std::string& line)
+    {
+        stream.clear();
+        stream.seekg(pos);
+        if (!std::getline(stream, line))
+        {
+            return -1;
+        }
+        int32_t doc, word, count;
+        if (!parse_docword(line.data(), line.data() + line.size(), doc, word, count))
+        {
+            return -1;
+        }
+        return doc;
+    }
+
+    /*!
+     * \brief moves the line aligned bounds of a docword file to doc
+     *  boundaries, so that the lines of a doc are in the same range
+     */
+    void align_docword_bounds(const std::string& file_name,
+        std::vector<int64_t>& bounds)
+    {
+        std::ifstream stream(file_name, std::ios::in | std::ios::binary);
+        std::string line;
+        int64_t file_size = bounds.back();
+        for (int32_t i = 1; i + 1 < bounds.size(); ++i)
+        {
+            int64_t pos = std::max(bounds[i], bounds[i - 1]);
+            int32_t doc = docword_doc_at(stream, pos, line);
+            if (doc >= 0)
+            {
+                // skip the lines of the doc at pos, it goes to range i - 1
+                while (pos < file_size && docword_doc_at(stream, pos, line) == doc)
+                {
+                    pos += line.size() + 1;
+                }
+            }
+            bounds[i] = std::min(pos, file_size);
+        }
+    }
+
+    /*!
+     * \brief counts a byte range of the input. With libsvm_part not empty,
+     *  UCI docs are also written there in libsvm format
+     */
+    void count_range(const std::string& file_name, bool uci,
+        const std::string& libsvm_part, range_stats& range)
+    {
+        utf8_stream stream(1024 * 1024 * 64);
+        if (!stream.open(file_name, range.begin, range.end))
+        {
+            std::cout << "Fails to open file: " << file_name << std::endl;
+            exit(1);
+        }
+        std::ofstream libsvm_file;
+        if (!libsvm_part.empty())
+        {
+            libsvm_file.open(libsvm_part, std::ios::out | std::ios::binary);
+            if (!libsvm_file.good())
+            {
+                std::cout << "Fails to create file: " << libsvm_part << std::endl;
+                exit(1);
+            }
+        }
+
+        const char* line_begin = nullptr;
+        const char* line_end = nullptr;
+        int32_t last_doc = -1;
+        std::string doc;
+        while (stream.getline(line_begin, line_end))
+        {
+            if (uci)
+            {
+                int32_t doc_id, word, count;
+                if (!parse_docword(line_begin, line_end, doc_id, word, count))
+                {
+                    // the header lines have a single number
+                    continue;
+                }
+                add_tf(range.tf, word - 1, count);
+                range.token_num += count;
+                if (doc_id != last_doc)
+                {
+                    ++range.doc_num;
+                    last_doc = doc_id;
+                    if (!libsvm_file.is_open())
+                    {
+                        continue;
+                    }
+                    if (!doc.empty())
+                    {
+                        doc.back() = '\n';
+                        libsvm_file.write(doc.data(), doc.size());
+                    }
+                    doc = std::to_string(doc_id) + '\t';
+                }
+                if (libsvm_file.is_open())
+                {
+                    doc += std::to_string(word - 1) + ':' + std::to_string(count) + ' ';
+                }
+            }
+            else
+            {
+                bool valid = parse_libsvm(line_begin, line_end,
+                    [&](int32_t word, int32_t count)
+                {
+                    add_tf(range.tf, word, count);
+                    range.token_num += count;
+                    return true;
+                });
+                if (!valid)
+                {
+                    std::cout << "Invalid format, not key TAB word:count ...: "
+                        << std::string(line_begin, line_end) << std::endl;
+                    exit(1);
+                }
+                ++range.doc_num;
+            }
+        }
+        if (libsvm_file.is_open())
+        {
+            if (!doc.empty())
+            {
+                doc.back() = '\n';
+                libsvm_file.write(doc.data(), doc.size());
+            }
+            libsvm_file.close();
+        }
+        range.bytes = stream.bytes_read();
+        if (!stream.close())
+        {
+            std::cout << "Fails to decompress file: " << file_name << std::endl;
+            exit(1);
+        }
+    }
+
+    /*! \brief concatenates the parts in order into file_name */
+    void concat_parts(const std::vector<std::string>& part_names,
+        const std::string& file_name)
+    {
+        std::ofstream out_file(file_name, std::ios::out | std::ios::binary);
+        if (!out_file.good())
+        {
+            std::cout << "Fails to create file: " << file_name << std::endl;
+            exit(1);
+        }
+        std::vector<char> buffer(1024 * 1024 * 16);
+        for (auto& part_name : part_names)
+        {
+            std::ifstream part_file(part_name, std::ios::in | std::ios::binary);
+            while (part_file.read(buffer.data(), buffer.size()) || part_file.gcount() > 0)
+            {
+                out_file.write(buffer.data(), part_file.gcount());
+            }
+            part_file.close();
+            std::remove(part_name.c_str());
+        }
+        out_file.close();
+    }
+}
+
+double get_time()
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    auto since_epoch = start.time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::duration<double, std::ratio<1, 1>>>(since_epoch).count();
+}
+
+void print_usage()
+{
+    printf("Usage: corpus_stats <input> <word_dict_file_output> [options]\n");
+    printf("  input \"-\" reads the standard input, .gz and .zst files are read\n");
+    printf("  through gzip or zstd, both with one thread\n");
+    printf("Options:\n");
+    printf("  -format <arg>        Input format, libsvm or uci. Default: libsvm\n");
+    printf("  -vocab <arg>         Vocab file with a word per line, for the word\n");
+    printf("                       column of the dict. Default: \"word\" for all\n");
+    printf("  -libsvm_output <arg> Write the UCI input in libsvm format\n");
+    printf("  -num_threads <arg>   Number of threads. Default: 1\n");
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3 || (argc - 3) % 2 != 0)
+    {
+        print_usage();
+        exit(1);
+    }
+    std::string input_name(argv[1]);
+    std::string dict_name(argv[2]);
+    std::string format = "libsvm";
+    std::string vocab_name;
+    std::string libsvm_output;
+    int32_t num_threads = 1;
+    for (int i = 3; i < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-format") == 0) format = argv[i + 1];
+        else if (strcmp(argv[i], "-vocab") == 0) vocab_name = argv[i + 1];
+        else if (strcmp(argv[i], "-libsvm_output") == 0) libsvm_output = argv[i + 1];
+        else if (strcmp(argv[i], "-num_threads") == 0) num_threads = atoi(argv[i + 1]);
+        else
+        {
+            print_usage();
+            exit(1);
+        }
+    }
+    bool uci = (format == "uci");
+    if ((!uci && format != "libsvm") || num_threads <= 0 ||
+        (!libsvm_output.empty() && !uci))
+    {
+        print_usage();
+        exit(1);
+    }
+    if (lightlda::is_stream_input(input_name))
+    {
+        num_threads = 1;
+    }
+
+    double start = get_time();
+
+    // 1. split the input and count each range in parallel
+    std::vector<int64_t> bounds = lightlda::split_file(input_name, num_threads);
+    if (uci && num_threads > 1)
+    {
+        lightlda::align_docword_bounds(input_name, bounds);
+    }
+    std::vector<lightlda::range_stats> ranges(num_threads);
+    std::vector<std::string> part_names;
+    for (int32_t i = 0; i < num_threads; ++i)
+    {
+        ranges[i].begin = bounds[i];
+        ranges[i].end = bounds[i + 1];
+        part_names.push_back(libsvm_output.empty() ? "" :
+            libsvm_output + ".part" + std::to_string(i));
+    }
+    lightlda::parallel_for(num_threads, num_threads, [&](int32_t i)
+    {
+        lightlda::count_range(input_name, uci, part_names[i], ranges[i]);
+    });
+
+    // 2. merge the counts
+    std::vector<int64_t> tf;
+    int64_t bytes = 0, doc_num = 0, token_num = 0;
+    for (auto& range : ranges)
+    {
+        if (range.tf.size() > tf.size())
+        {
+            tf.resize(range.tf.size(), 0);
+        }
+        for (size_t word = 0; word < range.tf.size(); ++word)
+        {
+            tf[word] += range.tf[word];
+        }
+        bytes += range.bytes;
+        doc_num += range.doc_num;
+        token_num += range.token_num;
+    }
+    if (!libsvm_output.empty())
+    {
+        lightlda::concat_parts(part_names, libsvm_output);
+    }
+
+    // 3. write the dict, word_id TAB word TAB tf
+    std::vector<std::string> vocab;
+    if (!vocab_name.empty())
+    {
+        lightlda::utf8_stream vocab_file(1024 * 1024 * 16);
+        if (!vocab_file.open(vocab_name))
+        {
+            std::cout << "Fails to open file: " << vocab_name << std::endl;
+            exit(1);
+        }
+        std::string line;
+        while (vocab_file.getline(line))
+        {
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+            {
+                line.pop_back();
+            }
+            vocab.push_back(line);
+        }
+        vocab_file.close();
+    }
+    std::ofstream dict_file(dict_name, std::ios::out | std::ios::binary);
+    if (!dict_file.good())
+    {
+        std::cout << "Fails to create file: " << dict_name << std::endl;
+        exit(1);
+    }
+    int32_t word_num = 0;
+    int64_t max_word_id = -1;
+    std::string line;
+    for (size_t word = 0; word < tf.size(); ++word)
+    {
+        if (tf[word] == 0)
+        {
+            continue;
+        }
+        if (tf[word] > INT32_MAX)
+        {
+            std::cout << "Term frequency of word " << word << " is larger than int32" << std::endl;
+            exit(1);
+        }
+        line = std::to_string(word) + '\t' +
+            (word < vocab.size() ? vocab[word] : "word") + '\t' +
+            std::to_string(tf[word]) + '\n';
+        dict_file.write(line.data(), line.size());
+        ++word_num;
+        max_word_id = word;
+    }
+    dict_file.close();
+
+    double seconds = get_time() - start;
+    std::cout << "There are totally " << doc_num << " docs, " << token_num
+        << " tokens and " << word_num << " words" << std::endl;
+    std::cout << "Max word id is " << max_word_id << std::endl;
+    std::cout << "Elapsed seconds for corpus stats: " << seconds << ", "
+        << bytes / 1024.0 / 1024.0 / seconds << " MB/s with "
+        << num_threads << " threads" << std::endl;
+    return 0;
+}
@@ -2,116 +2,124 @@
  * \file dump_binary.cpp
  * \brief Preprocessing tool for converting LibSVM data to LightLDA input binary format
  *  Usage: 
- *    dump_binary <libsvm_input> <word_dict_file_input> <binary_output_dir> <output_file_offset>
+ *    dump_binary <libsvm_input> <word_dict_file_input> <binary_output_dir> <output_file_offset> [options]
+ *    libsvm_input "-" reads the standard input, e.g. from a decompressor,
+ *    .gz and .zst files are read through gzip or zstd. Comma separated files
+ *    are dumped in parallel, to one block or to one block per file
+ *    word_dict_file_input "none" counts the global tf from the input itself,
+ *    when the input is the whole corpus
+ *  Options:
+ *    -num_threads <arg> Number of parsing threads. Default: 1
+ *    -num_blocks <arg>  Number of output blocks, numbered from output_file_offset. Default: 1
+ *    -word_map <arg>    Renumber the words by the word map of remap_vocab
+ *    -run_length        Store each distinct word of a doc once with its count
+ *    -dedup <arg>       Remove duplicate docs, and near duplicates whose SimHash
+ *                       differs in at most arg bits, 0 to 3
+ *    -benchmark         Only parse the input and print the parsing speed
  */
 
 #include <algorithm>
 #include <chrono>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "block_format.h"
+#include "libsvm_tokenizer.h"
+#include "parallel_for.h"
+#include "utf8_stream.h"
+#include "word_map.h"
+
 namespace lightlda
 {
     /* 
-     * Output file format:
-     * 1, the first 4 byte indicates the number of docs in this block
-     * 2, the 4 * (doc_num + 1) bytes indicate the offset of reach doc
+     * Output file format, see block_format.h, offsets are written after the
+     * documents so that the input is converted in a single pass:
+     * 1, the header with the layout, the number of docs and tokens and the
+     *    histogram of doc lengths, written last once the block is complete
+     * 2, the token-topic lists of the docs, each led by a cursor (int32)
+     * 3, the 8 * (doc_num + 1) bytes indicate the offset of each doc
      * an example
-     * 3    // there are 3 docs in this block
+     * header       // 3 docs, 12 tokens
+     * 0 w11 t11 w12 t12 w13 t13 w14 t14 w15 t15  // the token-topic list of the 1-st doc
+     * 0 w21 t21 w22 t22 w23 t23                  // the token-topic list of the 2-nd doc
+     * 0 w31 t31 w32 t32 w33 t33 w34 t34          // the token-topic list of the 3-rd doc
      * 0    // the offset of the 1-st doc
-     * 10   // the offset of the 2-nd doc, with this we know the length of the 1-st doc is 5 = 10/2
-     * 16   // the offset of the 3-rd doc, with this we know the length of the 2-nd doc is 3 = (16-10)/2
-     * 24   // with this, we know the length of the 3-rd doc is 4 = (24 - 16)/2
-     * w11 t11 w12 t12 w13 t13 w14 t14 w15 t15  // the token-topic list of the 1-st doc
-     * w21 t21 w22 t22 w23 t23                     // the token-topic list of the 2-nd doc
-     * w31 t31 w32 t32 w33 t33 w34 t34             // the token-topic list of the 3-rd doc
+     * 11   // the offset of the 2-nd doc, with this we know the length of the 1-st doc is 5 = (11 - 1)/2
+     * 18   // the offset of the 3-rd doc, with this we know the length of the 2-nd doc is 3 = (18 - 11 - 1)/2
+     * 27   // with this, we know the length of the 3-rd doc is 4 = (27 - 18 - 1)/2
+     *
+     * With -run_length, the layout is kRunLengthLayout and each doc stores
+     * its distinct words once with their counts, then the topic of each token:
+     * 0 k w1 c1 w2 c2 ... wk ck t1 t2 ... tn     // n = c1 + c2 + ... + ck
+     * It is smaller when words repeat in docs, 3 int32 per distinct word and
+     * 1 per token, against 2 per token.
 
      * the class block_stream helps generate such binary format file, usage:
-     * int doc_num = 3;
-     * int64_t* offset_buf = new int64_t[doc_num + 1];
-     *
      * block_stream bs;
      * bs.open("block");
-     * bs.write_empty_header(offset_buf, doc_num);
+     * bs.write_head();
+     * bs.write_doc(doc_buf, doc_idx, doc_length);
      * ...
-     * // update offset_buf and doc_num...
-
-     * bs.write_doc(doc_buf, doc_idx);
-     * ...
-     * bs.write_real_header(offset_buf, doc_num);
+     * bs.write_tail();
      * bs.close();
+     *
+     * The offsets are kept in a side file "block.offsets" until write_tail.
      */
     class block_stream
     {
     public:
-        block_stream();
+        // assuming each doc has 500 tokens in average, 
+        // the default block_buf_ will hold 1 million document,
+        // needs 0.8GB RAM.
+        explicit block_stream(int32_t block_buf_size = 1024 * 1024 * 2 * 100,
+            int32_t layout = kInterleavedLayout);
         ~block_stream();
         bool open(const std::string file_name);
-        bool write_doc(int32_t* int32_buf, int32_t count);
-        bool write_empty_header(int64_t* int64_buf, int64_t count);
-        bool write_real_header(int64_t* int64_buf, int64_t count);
-        bool seekp(int64_t pos);
+        bool write_head();
+        // write a doc of doc_length tokens taking count int32
+        bool write_doc(int32_t* int32_buf, int32_t count, int32_t doc_length);
+        // append the offsets and write the header
+        bool write_tail();
+        // dump the content in block_buf_ and offset_buf_ to disk
+        bool flush();
         bool close();
+        int64_t doc_num() const { return header_.doc_num; }
+        int64_t corpus_size() const { return header_.corpus_size; }
+        const block_file_header& header() const { return header_; }
+        std::string offset_file_name() const { return file_name_ + ".offsets"; }
     private:
-        // assuming each doc has 500 tokens in average, 
-        // the block_buf_ will hold 1 million document,
-        // needs 0.8GB RAM.
-        const int32_t block_buf_size_ = 1024 * 1024 * 2 * 100;
+        void write_offset(int64_t offset);
+        const int32_t block_buf_size_;
+        const int32_t offset_buf_size_ = 1024 * 1024;
+        const int32_t layout_;
 
         std::ofstream stream_;
+        std::ofstream offset_stream_;
         std::string file_name_;
 
         int32_t *block_buf_;
         int32_t buf_idx_;
+        std::vector<int64_t> offset_buf_;
+        block_file_header header_;
 
         block_stream(const block_stream& other) = delete;
         block_stream& operator=(const block_stream& other) = delete;
     };
 
-    /*
-    (1) open an utf-8 encoded file in binary mode,
-    get its content line by line. Working around the CTRL-Z issue in Windows text file reading.
-    (2) assuming each line ends with '\n'
-    */
-    class utf8_stream
-    {
-    public:
-        utf8_stream();
-        ~utf8_stream();
-
-        bool open(const std::string& file_name);
-
-        /*
-        return true if successfully get a line (may be empty), false if not.
-        It is user's task to verify whether a line is empty or not.
-        */
-        bool getline(std::string &line);
-        int64_t count_line();
-        bool close();
-    private:
-        bool block_is_empty();
-        bool fill_block();
-        std::ifstream stream_;
-        std::string file_name_;
-        const int32_t block_buf_size_ = 1024 * 1024 * 800;
-        // const int32_t block_buf_size_ = 2;
-        std::string block_buf_;
-        std::string::size_type buf_idx_;
-        std::string::size_type buf_end_;
-
-        utf8_stream(const utf8_stream& other) = delete;
-        utf8_stream& operator=(const utf8_stream& other) = delete;
-    };
-
-    block_stream::block_stream()
-        : buf_idx_(0)
+    block_stream::block_stream(int32_t block_buf_size, int32_t layout)
+        : block_buf_size_(block_buf_size), layout_(layout), buf_idx_(0),
+        header_(new_block_header(layout))
     {
         block_buf_ = new int32_t[block_buf_size_];
+        offset_buf_.reserve(offset_buf_size_);
     }
     block_stream::~block_stream()
     {
@@ -125,39 +133,73 @@ namespace lightlda
     {
         file_name_ = file_name;
         stream_.open(file_name_, std::ios::out | std::ios::binary);
-        return stream_.good();
+        offset_stream_.open(offset_file_name(), std::ios::out | std::ios::binary);
+        buf_idx_ = 0;
+        header_ = new_block_header(layout_);
+        offset_buf_.clear();
+        write_offset(0);
+        return stream_.good() && offset_stream_.good();
     }
 
-    bool block_stream::seekp(int64_t pos)
+    bool block_stream::write_head()
     {
-        stream_.seekp(pos);
+        block_file_header incomplete = header_;
+        incomplete.magic = kIncompleteMagic;
+        stream_.write(reinterpret_cast<char*>(&incomplete), sizeof(incomplete));
         return true;
     }
 
-    bool block_stream::write_empty_header(int64_t* int64_buf, int64_t count)
+    void block_stream::write_offset(int64_t offset)
     {
-        stream_.write(reinterpret_cast<char*>(&count), sizeof(int64_t));
-        stream_.write(reinterpret_cast<char*>(int64_buf), 
-            sizeof(int64_t)* (count + 1));
-        return true;
+        if (offset_buf_.size() == offset_buf_size_)
+        {
+            offset_stream_.write(reinterpret_cast<char*>(offset_buf_.data()),
+                sizeof(int64_t)* offset_buf_.size());
+            offset_buf_.clear();
+        }
+        offset_buf_.push_back(offset);
     }
 
-    bool block_stream::write_real_header(int64_t* int64_buf, int64_t count)
+    bool block_stream::flush()
     {
-        // clear off the block_buf_, if any content not dumped to disk
         if (buf_idx_ != 0)
         {
             stream_.write(reinterpret_cast<char*> (block_buf_), 
                 sizeof(int32_t)* buf_idx_);
             buf_idx_ = 0;
         }
+        offset_stream_.write(reinterpret_cast<char*>(offset_buf_.data()),
+            sizeof(int64_t)* offset_buf_.size());
+        offset_buf_.clear();
+        stream_.flush();
+        offset_stream_.flush();
+        return stream_.good() && offset_stream_.good();
+    }
 
-        seekp(0);
-        write_empty_header(int64_buf, count);
-        return true;
+    bool block_stream::write_tail()
+    {
+        // clear off the buffers, if any content not dumped to disk
+        if (!flush())
+        {
+            return false;
+        }
+        offset_stream_.close();
+
+        std::ifstream offset_file(offset_file_name(), std::ios::in | std::ios::binary);
+        std::vector<char> buffer(sizeof(int64_t)* offset_buf_size_);
+        while (offset_file.read(buffer.data(), buffer.size()) || offset_file.gcount() > 0)
+        {
+            stream_.write(buffer.data(), offset_file.gcount());
+        }
+        offset_file.close();
+        std::remove(offset_file_name().c_str());
+
+        stream_.seekp(0);
+        stream_.write(reinterpret_cast<char*>(&header_), sizeof(header_));
+        return stream_.good();
     }
 
-    bool block_stream::write_doc(int32_t* int32_buf, int32_t count)
+    bool block_stream::write_doc(int32_t* int32_buf, int32_t count, int32_t doc_length)
     {
         if (buf_idx_ + count > block_buf_size_)
         {
@@ -167,116 +209,183 @@ namespace lightlda
         }
         memcpy(block_buf_ + buf_idx_, int32_buf, count * sizeof(int32_t));
         buf_idx_ += count;
+        add_doc(header_, doc_length, count);
+        write_offset(header_.corpus_size);
         return true;
     }
 
     bool block_stream::close()
     {
         stream_.close();
+        if (offset_stream_.is_open())
+        {
+            offset_stream_.close();
+        }
         return true;
     }
 
-    utf8_stream::utf8_stream()
+    /* a document of the input, by the range it is in and its index there */
+    struct doc_ref
+    {
+        int32_t range;
+        int32_t index;
+    };
+
+    /*! \brief the hashes of a document compared by doc_dedup */
+    struct doc_signature
+    {
+        uint64_t hash;
+        uint64_t check;
+        uint64_t simhash;
+        int64_t length;
+    };
+
+    /*
+     * Finds duplicate documents. Exact
+     * duplicates have the same length and the same two independent 64 bit
+     * hashes of the sorted token list, so a collision of one hash does not
+     * drop a distinct doc. Near
+     * duplicates have 64 bit SimHash signatures within max_distance bits.
+     * They are found by cutting signatures into max_distance + 1 bands, as
+     * two such signatures are equal in at least one band. Docs are signed
+     * by any thread but added by one thread in input order, so the first
+     * copy of the input is kept, whatever the number of threads.
+     */
+    class doc_dedup
+    {
+    public:
+        // short docs are only checked for exact duplicates
+        static const int32_t kMinNearDupLength = 16;
+
+        explicit doc_dedup(int32_t max_distance);
+        // the signature of the sorted words
+        doc_signature sign(const std::vector<int32_t>& words) const;
+        // the kept doc of a duplicate of the signed doc, or ref itself if
+        // the doc is not a duplicate and is added
+        doc_ref find_or_add(const doc_signature& doc, doc_ref ref);
+    private:
+        struct signature
+        {
+            uint64_t simhash;
+            doc_ref ref;
+        };
+        struct exact_doc
+        {
+            uint64_t check;
+            int64_t length;
+            doc_ref ref;
+        };
+        static uint64_t mix(uint64_t x);
+        uint64_t band(uint64_t simhash, int32_t i) const;
+
+        const int32_t max_distance_;
+        const int32_t band_bits_;
+        // the first hash to the second hash and the length of docs
+        std::unordered_multimap<uint64_t, exact_doc> exact_;
+        std::vector<std::unordered_map<uint64_t, std::vector<signature>>> bands_;
+    };
+
+    doc_dedup::doc_dedup(int32_t max_distance)
+        : max_distance_(max_distance), band_bits_(64 / (max_distance + 1)),
+        bands_(max_distance > 0 ? max_distance + 1 : 0)
     {
-        block_buf_.resize(block_buf_size_);
     }
-    utf8_stream::~utf8_stream()
+
+    // the finalizer of splitmix64
+    uint64_t doc_dedup::mix(uint64_t x)
     {
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
     }
 
-    bool utf8_stream::open(const std::string& file_name)
+    uint64_t doc_dedup::band(uint64_t simhash, int32_t i) const
     {
-        stream_.open(file_name, std::ios::in | std::ios::binary);
-        buf_idx_ = 0;
-        buf_end_ = 0;
-        return stream_.good();
+        // the last band takes the bits left
+        int32_t bits = (i + 1 == bands_.size()) ? 64 - i * band_bits_ : band_bits_;
+        uint64_t mask = (bits == 64) ? ~0ULL : ((1ULL << bits) - 1);
+        return (simhash >> (i * band_bits_)) & mask;
     }
 
-    bool utf8_stream::getline(std::string& line)
+    doc_signature doc_dedup::sign(const std::vector<int32_t>& words) const
     {
-        line = "";
-        while (true)
+        uint64_t hash = mix(words.size());
+        uint64_t check = mix(words.size() + 0x9E3779B97F4A7C15ULL);
+        for (auto word : words)
+        {
+            hash = mix(hash ^ static_cast<uint32_t>(word));
+            check = mix(check + 0x9E3779B97F4A7C15ULL * (static_cast<uint32_t>(word) + 1));
+        }
+        uint64_t simhash = 0;
+        if (!bands_.empty() && words.size() >= kMinNearDupLength)
         {
-            if (block_is_empty())
+            // each bit is the sign of the sum of word hash bits, +1 for a 1
+            // bit and -1 for a 0 bit, weighted by the count of the word
+            int32_t weights[64] = { 0 };
+            for (size_t i = 0; i < words.size();)
             {
-                // if the block_buf_ is empty, fill the block_buf_
-                if (!fill_block())
+                size_t j = i;
+                while (j < words.size() && words[j] == words[i]) ++j;
+                uint64_t word_hash = mix(static_cast<uint32_t>(words[i]) + 1);
+                int32_t count = static_cast<int32_t>(j - i);
+                for (int32_t b = 0; b < 64; ++b)
                 {
-                    // if fail to fill the block_buf_, that means we reach the end of file
-                    if (!line.empty())
-                        std::cout << "Invalid format, according to our assumption: "
-                       "each line has an \\n. However, we reach here with an non-empty line but not find an \\n";
-                    return false;
+                    weights[b] += ((word_hash >> b) & 1) ? count : -count;
                 }
+                i = j;
             }
-            // the block is not empty now
-
-            std::string::size_type end_pos = block_buf_.find("\n", buf_idx_);
-            if (end_pos != std::string::npos)
-            {
-                // successfully find a new line
-                line += block_buf_.substr(buf_idx_, end_pos - buf_idx_);
-                buf_idx_ = end_pos + 1;
-                return true;
-            }
-            else
+            for (int32_t b = 0; b < 64; ++b)
             {
-                // do not find an \n untile the end of block_buf_
-                line += block_buf_.substr(buf_idx_, buf_end_ - buf_idx_);
-                buf_idx_ = buf_end_;
+                if (weights[b] > 0) simhash |= 1ULL << b;
             }
         }
-        return false;
+        return { hash, check, simhash, static_cast<int64_t>(words.size()) };
     }
 
-    int64_t utf8_stream::count_line()
+    doc_ref doc_dedup::find_or_add(const doc_signature& doc, doc_ref ref)
     {
-        char* buffer = &block_buf_[0];
-
-        int64_t line_num = 0;
-        while (true)
+        auto range = exact_.equal_range(doc.hash);
+        for (auto it = range.first; it != range.second; ++it)
         {
-            stream_.read(buffer, block_buf_size_);
-            int32_t end_pos = static_cast<int32_t>(stream_.gcount());
-            if (end_pos == 0)
+            if (it->second.check == doc.check && it->second.length == doc.length)
             {
-                break;
+                return it->second.ref;
             }
-            line_num += std::count(buffer, buffer + end_pos, '\n');
         }
-        return line_num;
-    }
-
-    bool utf8_stream::block_is_empty()
-    {
-        return buf_idx_ == buf_end_;
-    }
-
-    bool utf8_stream::fill_block()
-    {
-        char* buffer = &block_buf_[0];
-        stream_.read(buffer, block_buf_size_);
-        buf_idx_ = 0;
-        buf_end_ = static_cast<std::string::size_type>(stream_.gcount());
-        return buf_end_ != 0;
-    }
-
-    bool utf8_stream::close()
-    {
-        stream_.close();
-        return true;
+        if (!bands_.empty() && doc.length >= kMinNearDupLength)
+        {
+            uint64_t simhash = doc.simhash;
+            for (int32_t i = 0; i < bands_.size(); ++i)
+            {
+                auto band_it = bands_[i].find(band(simhash, i));
+                if (band_it == bands_[i].end())
+                {
+                    continue;
+                }
+                for (auto& other : band_it->second)
+                {
+                    uint64_t diff = other.simhash ^ simhash;
+                    int32_t distance = 0;
+                    for (; diff != 0 && distance <= max_distance_; ++distance)
+                    {
+                        diff &= diff - 1;
+                    }
+                    if (distance <= max_distance_)
+                    {
+                        return other.ref;
+                    }
+                }
+            }
+            for (int32_t i = 0; i < bands_.size(); ++i)
+            {
+                bands_[i][band(simhash, i)].push_back({ simhash, ref });
+            }
+        }
+        exact_.emplace(doc.hash, exact_doc{ doc.check, doc.length, ref });
+        return ref;
     }
 }
 
-struct Token {
-    int32_t word_id;
-    int32_t topic_id;
-};
-
-int Compare(const Token& token1, const Token& token2) {
-    return token1.word_id < token2.word_id;
-}
-
 double get_time()
 {
     auto start = std::chrono::high_resolution_clock::now();
@@ -338,21 +447,17 @@ void split_string(std::string& line, char separator, std::vector<std::string>& o
     return;
 }
 
-void count_doc_num(std::string input_doc, int64_t &doc_num)
-{
-    lightlda::utf8_stream stream;
-    if (!stream.open(input_doc))
-    {
-        std::cout << "Fails to open file: " << input_doc << std::endl;
-        exit(1);
-    }
-    doc_num = stream.count_line();
-    stream.close();
-}
+// buffer sizes of each dumping thread
+const int32_t kReadBufSize = 1024 * 1024 * 64;
+const int32_t kWriteBufSize = 1024 * 1024 * 16;
 
-void load_global_tf(std::unordered_map<int32_t, int32_t>& global_tf_map,
+/*
+ * load the word_id TAB word TAB tf lines of the word dict into global_tf,
+ * indexed by word id, words not in the dict have tf 0
+ */
+void load_global_tf(std::vector<int32_t>& global_tf,
     std::string word_tf_file,
-    int64_t& global_tf_count)
+    int64_t& global_tf_count, int32_t& dict_size)
 {
     lightlda::utf8_stream stream;
     if (!stream.open(word_tf_file))
@@ -360,6 +465,9 @@ void load_global_tf(std::unordered_map<int32_t, int32_t>& global_tf_map,
         std::cout << "Fails to open file: " << word_tf_file << std::endl;
         exit(1);
     }
+    // -1 until a word is seen, to detect duplicates
+    global_tf.clear();
+    dict_size = 0;
     std::string line;
     while (stream.getline(line))
     {
@@ -372,62 +480,123 @@ void load_global_tf(std::unordered_map<int32_t, int32_t>& global_tf_map,
         }
         int32_t word_id = std::stoi(output[0]);
         int32_t tf = std::stoi(output[2]);
-        auto it = global_tf_map.find(word_id);
-        if (it != global_tf_map.end())
+        if (word_id < 0)
+        {
+            std::cout << "Invalid line: " << line << std::endl;
+            exit(1);
+        }
+        if (word_id >= global_tf.size())
+        {
+            global_tf.resize(std::max<size_t>(word_id + 1, global_tf.size() * 2), -1);
+        }
+        if (global_tf[word_id] != -1)
         {
             std::cout << "Duplicate words detected: " << line << std::endl;
             exit(1);
         }
-        global_tf_map.insert(std::make_pair(word_id, tf));
+        global_tf[word_id] = tf;
         global_tf_count += tf;
+        ++dict_size;
     }
     stream.close();
+    int32_t word_num = 0;
+    for (int32_t word = 0; word < global_tf.size(); ++word)
+    {
+        if (global_tf[word] == -1)
+        {
+            global_tf[word] = 0;
+        }
+        else
+        {
+            word_num = word + 1;
+        }
+    }
+    global_tf.resize(word_num);
 }
 
-int main(int argc, char* argv[])
+/* the documents of a byte range of a libsvm input file */
+struct range_dump
+{
+    std::string file_name;
+    int64_t begin;
+    int64_t end;
+    int64_t bytes = 0;
+    int64_t doc_num = 0;
+    int64_t token_num = 0;
+    int64_t corpus_size = 0;
+    lightlda::block_file_header header;
+    std::vector<int32_t> local_tf;
+    // with -dedup, the doc kept for each input doc, itself if not removed
+    std::vector<lightlda::doc_ref> kept_docs;
+    int64_t dup_doc_num = 0;
+    int64_t dup_token_num = 0;
+};
+
+/*
+ * tokenize a line of the libsvm input into its sorted word ids, exits on
+ * an invalid line. word_num is 0 when there is no word dict, then any word
+ * id is accepted. With old_to_new not empty, word ids are renumbered by
+ * the word map.
+ */
+void read_doc(const char* line_begin, const char* line_end,
+    int32_t max_doc_length, int32_t word_num,
+    const std::vector<int32_t>& old_to_new, std::vector<int32_t>& doc_words)
 {
-    if (argc != 5)
+    if (!lightlda::tokenize_libsvm(line_begin, line_end, max_doc_length, doc_words))
+    {
+        std::cout << "Invalid format, not key TAB word:count ...: "
+            << std::string(line_begin, line_end) << std::endl;
+        exit(1);
+    }
+    if (!old_to_new.empty())
+    {
+        for (auto& word_id : doc_words)
+        {
+            word_id = (word_id < old_to_new.size()) ? old_to_new[word_id] : -1;
+            if (word_id < 0)
+            {
+                std::cout << "Word id not in word map: "
+                    << std::string(line_begin, line_end) << std::endl;
+                exit(1);
+            }
+        }
+    }
+    // The input data may be already sorted
+    std::sort(doc_words.begin(), doc_words.end());
+    if (word_num > 0 && !doc_words.empty() && doc_words.back() >= word_num)
     {
-        printf("Usage: dump_binary <libsvm_input> <word_dict_file_input> <binary_output_dir> <output_file_offset>\n");
+        std::cout << "Word id not in word dict: "
+            << std::string(line_begin, line_end) << std::endl;
         exit(1);
     }
+}
 
-    std::string libsvm_file_name(argv[1]);
-    std::string word_dict_file_name(argv[2]);
-    std::string output_dir(argv[3]);
-    int32_t output_offset = atoi(argv[4]);
+/*
+ * convert a byte range of the libsvm input to a binary block in a single
+ * pass. With complete = false, only the documents are written and the
+ * offsets are left in the side file, to be merged into one block.
+ * With dedup, the duplicate docs of a single range are found while
+ * dumping. The docs whose kept doc in range.kept_docs, filled by dedup or
+ * before by find_duplicates, is another one are not written. range_index
+ * is the index of the range to refer to its docs.
+ */
+void dump_range(int32_t word_num,
+    const std::vector<int32_t>& old_to_new, bool run_length,
+    lightlda::doc_dedup* dedup, int32_t range_index,
+    const std::string& block_name, bool complete, range_dump& range)
+{
     const int32_t kMaxDocLength = 8192;
 
-    // 1. count how many documents in the data set
-    int64_t doc_num;
-    count_doc_num(libsvm_file_name, doc_num);
-
-    // 2. load the word_dict file, get the global {word_id, tf} mapping
-    std::unordered_map<int32_t, int32_t> global_tf_map;
-    std::unordered_map<int32_t, int32_t> local_tf_map;
-    int64_t global_tf_count = 0;
-    load_global_tf(global_tf_map, word_dict_file_name, global_tf_count);
-    int32_t word_num = global_tf_map.size();
-    std::cout << "There are totally " << word_num 
-			<< " words in the vocabulary" << std::endl;
-    std::cout << "There are maximally totally " << global_tf_count 
-			<< " tokens in the data set" << std::endl;
-
-    // 3. transform the libsvm -> binary block
-    int64_t* offset_buf = new int64_t[doc_num + 1];
-    int32_t *doc_buf = new int32_t[kMaxDocLength * 2 + 1];
-
-    std::string block_name = output_dir + "/block." + std::to_string(output_offset);
-    std::string vocab_name = output_dir + "/vocab." + std::to_string(output_offset);
-    std::string txt_vocab_name = output_dir + "/vocab." + std::to_string(output_offset) + ".txt";
+    range.local_tf.assign(word_num, 0);
+    std::vector<int32_t> doc_buf(kMaxDocLength * 3 + 2);
 
-    // open file
-    lightlda::utf8_stream libsvm_file;
-    lightlda::block_stream block_file;
+    lightlda::utf8_stream libsvm_file(kReadBufSize);
+    lightlda::block_stream block_file(kWriteBufSize,
+        run_length ? lightlda::kRunLengthLayout : lightlda::kInterleavedLayout);
 
-    if (!libsvm_file.open(libsvm_file_name))
+    if (!libsvm_file.open(range.file_name, range.begin, range.end))
     {
-        std::cout << "Fails to open file: " << libsvm_file_name << std::endl;
+        std::cout << "Fails to open file: " << range.file_name << std::endl;
         exit(1);
     }
     if (!block_file.open(block_name))
@@ -435,8 +604,358 @@ int main(int argc, char* argv[])
         std::cout << "Fails to create file: " << block_name << std::endl;
         exit(1);
     }
+
+    if (complete)
+    {
+        block_file.write_head();
+    }
+    int32_t doc_buf_idx;
+
+    const char* line_begin = nullptr;
+    const char* line_end = nullptr;
+    std::vector<int32_t> doc_words;
+    size_t doc_index = 0;
+
+    while (libsvm_file.getline(line_begin, line_end))
+    {
+        read_doc(line_begin, line_end, kMaxDocLength, word_num, old_to_new, doc_words);
+        lightlda::doc_ref ref = { range_index, static_cast<int32_t>(block_file.doc_num()) };
+        if (dedup != nullptr)
+        {
+            range.kept_docs.push_back(doc_words.empty() ?
+                ref : dedup->find_or_add(dedup->sign(doc_words), ref));
+        }
+        if (doc_index < range.kept_docs.size())
+        {
+            const lightlda::doc_ref& kept = range.kept_docs[doc_index++];
+            if (kept.range != ref.range || kept.index != ref.index)
+            {
+                ++range.dup_doc_num;
+                range.dup_token_num += doc_words.size();
+                continue;
+            }
+        }
+        for (auto word_id : doc_words)
+        {
+            if (word_id >= range.local_tf.size())
+            {
+                // without a word dict, the vocabulary grows with the input
+                range.local_tf.resize(std::max<size_t>(word_id + 1,
+                    range.local_tf.size() * 2), 0);
+            }
+            range.local_tf[word_id]++;
+        }
+        range.token_num += doc_words.size();
+
+        doc_buf_idx = 0;
+        doc_buf[doc_buf_idx++] = 0; // cursor
+
+        if (run_length)
+        {
+            int32_t& num_runs = doc_buf[doc_buf_idx++];
+            num_runs = 0;
+            for (size_t i = 0; i < doc_words.size(); ++i)
+            {
+                if (i == 0 || doc_words[i] != doc_words[i - 1])
+                {
+                    doc_buf[doc_buf_idx++] = doc_words[i];
+                    doc_buf[doc_buf_idx++] = 0; // count
+                    ++num_runs;
+                }
+                ++doc_buf[doc_buf_idx - 1];
+            }
+            std::fill_n(doc_buf.begin() + doc_buf_idx, doc_words.size(), 0); // topics
+            doc_buf_idx += static_cast<int32_t>(doc_words.size());
+        }
+        else
+        {
+            for (auto word_id : doc_words)
+            {
+                doc_buf[doc_buf_idx++] = word_id;
+                doc_buf[doc_buf_idx++] = 0; // topic
+            }
+        }
+
+        block_file.write_doc(doc_buf.data(), doc_buf_idx,
+            static_cast<int32_t>(doc_words.size()));
+    }
+    range.bytes = libsvm_file.bytes_read();
+    range.doc_num = block_file.doc_num();
+    range.corpus_size = block_file.corpus_size();
+    range.header = block_file.header();
+    if (!(complete ? block_file.write_tail() : block_file.flush()))
+    {
+        std::cout << "Fails to write file: " << block_name << std::endl;
+        exit(1);
+    }
+
+    // close file and release resource
+    if (!libsvm_file.close())
+    {
+        std::cout << "Fails to decompress file: " << range.file_name << std::endl;
+        exit(1);
+    }
+    block_file.close();
+}
+
+/*
+ * split the comma separated input files into ranges. A single file that
+ * can be seeked is split at line ends into num_ranges ranges, otherwise
+ * each file is a range, so several compressed files are decompressed and
+ * parsed in parallel.
+ */
+std::vector<range_dump> split_inputs(const std::string& input_names, int32_t num_ranges)
+{
+    std::string names(input_names);
+    std::vector<std::string> file_names;
+    split_string(names, ',', file_names, true);
+    std::vector<range_dump> ranges;
+    if (file_names.size() == 1 && !lightlda::is_stream_input(file_names[0]))
+    {
+        std::vector<int64_t> bounds = lightlda::split_file(file_names[0], num_ranges);
+        ranges.resize(num_ranges);
+        for (int32_t i = 0; i < num_ranges; ++i)
+        {
+            ranges[i].file_name = file_names[0];
+            ranges[i].begin = bounds[i];
+            ranges[i].end = bounds[i + 1];
+        }
+        return ranges;
+    }
+    ranges.resize(file_names.size());
+    for (int32_t i = 0; i < file_names.size(); ++i)
+    {
+        if (file_names[i] == "-" && file_names.size() > 1)
+        {
+            std::cout << "Standard input can not be read with other files" << std::endl;
+            exit(1);
+        }
+        ranges[i].file_name = file_names[i];
+        ranges[i].begin = 0;
+        ranges[i].end = -1;
+    }
+    return ranges;
+}
+
+/*
+ * only tokenize a byte range of the libsvm input, to measure the parser
+ */
+void parse_range(range_dump& range)
+{
+    const int32_t kMaxDocLength = 8192;
+    lightlda::utf8_stream libsvm_file(kReadBufSize);
+    if (!libsvm_file.open(range.file_name, range.begin, range.end))
+    {
+        std::cout << "Fails to open file: " << range.file_name << std::endl;
+        exit(1);
+    }
+    const char* line_begin = nullptr;
+    const char* line_end = nullptr;
+    std::vector<int32_t> doc_words;
+    while (libsvm_file.getline(line_begin, line_end))
+    {
+        if (!lightlda::tokenize_libsvm(line_begin, line_end, kMaxDocLength, doc_words))
+        {
+            std::cout << "Invalid format, not key TAB word:count ...: "
+                << std::string(line_begin, line_end) << std::endl;
+            exit(1);
+        }
+        ++range.doc_num;
+        range.token_num += doc_words.size();
+    }
+    range.bytes = libsvm_file.bytes_read();
+    if (!libsvm_file.close())
+    {
+        std::cout << "Fails to decompress file: " << range.file_name << std::endl;
+        exit(1);
+    }
+}
+
+/*
+ * fill kept_docs of ranges for -dedup before they are dumped. The docs of
+ * ranges are signed in parallel, then added to dedup range by range in
+ * input order, so the kept copy of duplicates is the first of the input
+ * however the threads run. Each range is read again by dump_range.
+ */
+void find_duplicates(int32_t word_num, const std::vector<int32_t>& old_to_new,
+    lightlda::doc_dedup& dedup, std::vector<range_dump>& ranges, int32_t num_threads)
+{
+    const int32_t kMaxDocLength = 8192;
+    int32_t num_ranges = static_cast<int32_t>(ranges.size());
+    std::vector<std::vector<lightlda::doc_signature>> signatures(num_ranges);
+    lightlda::parallel_for(num_ranges, num_threads, [&](int32_t i)
+    {
+        lightlda::utf8_stream libsvm_file(kReadBufSize);
+        if (!libsvm_file.open(ranges[i].file_name, ranges[i].begin, ranges[i].end))
+        {
+            std::cout << "Fails to open file: " << ranges[i].file_name << std::endl;
+            exit(1);
+        }
+        const char* line_begin = nullptr;
+        const char* line_end = nullptr;
+        std::vector<int32_t> doc_words;
+        while (libsvm_file.getline(line_begin, line_end))
+        {
+            read_doc(line_begin, line_end, kMaxDocLength, word_num, old_to_new, doc_words);
+            signatures[i].push_back(dedup.sign(doc_words));
+        }
+        if (!libsvm_file.close())
+        {
+            std::cout << "Fails to decompress file: " << ranges[i].file_name << std::endl;
+            exit(1);
+        }
+    });
+    for (int32_t i = 0; i < num_ranges; ++i)
+    {
+        // the index of a doc is its index among the kept docs of its range
+        int32_t kept_num = 0;
+        ranges[i].kept_docs.reserve(signatures[i].size());
+        for (auto& doc : signatures[i])
+        {
+            lightlda::doc_ref ref = { i, kept_num };
+            lightlda::doc_ref kept = (doc.length > 0) ? dedup.find_or_add(doc, ref) : ref;
+            ranges[i].kept_docs.push_back(kept);
+            if (kept.range == ref.range && kept.index == ref.index)
+            {
+                ++kept_num;
+            }
+        }
+        std::vector<lightlda::doc_signature>().swap(signatures[i]);
+    }
+}
+
+/*
+ * merge the documents of ranges, dumped with dump_range as parts, into
+ * one block. The documents of parts are copied in parallel, each to its
+ * position, then the offsets of parts are shifted and appended.
+ */
+void merge_ranges(std::vector<range_dump>& ranges,
+    const std::vector<std::string>& part_names,
+    const std::string& block_name, int32_t layout, int32_t num_threads)
+{
+    lightlda::block_file_header header = lightlda::new_block_header(layout);
+    std::vector<int64_t> part_pos(ranges.size());
+    for (int32_t i = 0; i < ranges.size(); ++i)
+    {
+        part_pos[i] = sizeof(header) + sizeof(int32_t)* header.corpus_size;
+        lightlda::merge_header(header, ranges[i].header);
+    }
+
+    std::ofstream block_file(block_name, std::ios::out | std::ios::binary);
+    if (!block_file.good())
+    {
+        std::cout << "Fails to create file: " << block_name << std::endl;
+        exit(1);
+    }
+    lightlda::block_file_header incomplete = header;
+    incomplete.magic = lightlda::kIncompleteMagic;
+    block_file.write(reinterpret_cast<char*>(&incomplete), sizeof(incomplete));
+    block_file.close();
+
+    lightlda::parallel_for(static_cast<int32_t>(ranges.size()), num_threads, [&](int32_t i)
+    {
+        std::vector<char> buffer(kReadBufSize);
+        std::ifstream part_file(part_names[i], std::ios::in | std::ios::binary);
+        std::ofstream out_file(block_name,
+            std::ios::in | std::ios::out | std::ios::binary);
+        if (!part_file.good() || !out_file.good())
+        {
+            std::cout << "Fails to merge file: " << part_names[i] << std::endl;
+            exit(1);
+        }
+        out_file.seekp(part_pos[i]);
+        while (part_file.read(buffer.data(), buffer.size()) || part_file.gcount() > 0)
+        {
+            out_file.write(buffer.data(), part_file.gcount());
+        }
+        part_file.close();
+        out_file.close();
+        std::remove(part_names[i].c_str());
+    });
+
+    // the offsets of each part start from 0, shift them by the part position
+    block_file.open(block_name, std::ios::in | std::ios::out | std::ios::binary);
+    block_file.seekp(sizeof(header) + sizeof(int32_t)* header.corpus_size);
+    std::vector<int64_t> offset_buf(kWriteBufSize / 2);
+    int64_t shift = 0;
+    for (int32_t i = 0; i < ranges.size(); ++i)
+    {
+        std::string offset_name = part_names[i] + ".offsets";
+        std::ifstream offset_file(offset_name, std::ios::in | std::ios::binary);
+        // the first offset 0 of a part is the last offset of the previous one
+        if (i != 0)
+        {
+            offset_file.seekg(sizeof(int64_t));
+        }
+        while (offset_file.read(reinterpret_cast<char*>(offset_buf.data()),
+            sizeof(int64_t)* offset_buf.size()) || offset_file.gcount() > 0)
+        {
+            int64_t count = offset_file.gcount() / sizeof(int64_t);
+            for (int64_t j = 0; j < count; ++j)
+            {
+                offset_buf[j] += shift;
+            }
+            block_file.write(reinterpret_cast<char*>(offset_buf.data()),
+                sizeof(int64_t)* count);
+        }
+        offset_file.close();
+        std::remove(offset_name.c_str());
+        shift += ranges[i].corpus_size;
+    }
+    block_file.seekp(0);
+    block_file.write(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!block_file.good())
+    {
+        std::cout << "Fails to write file: " << block_name << std::endl;
+        exit(1);
+    }
+    block_file.close();
+}
+
+/*
+ * sum the local tf of ranges, the words are split into shards summed by
+ * num_threads threads, as a vocabulary can have tens of millions of words
+ */
+std::vector<int32_t> sum_local_tf(const std::vector<range_dump>& ranges,
+    int32_t num_threads)
+{
+    size_t word_num = 0;
+    for (auto& range : ranges)
+    {
+        word_num = std::max(word_num, range.local_tf.size());
+    }
+    std::vector<int32_t> local_tf(word_num, 0);
+    const size_t kShardSize = 1024 * 1024;
+    size_t num_shards = (word_num + kShardSize - 1) / kShardSize;
+    lightlda::parallel_for(static_cast<int32_t>(num_shards), num_threads, [&](int32_t shard)
+    {
+        size_t shard_end = std::min(word_num, (shard + 1) * kShardSize);
+        for (auto& range : ranges)
+        {
+            size_t end = std::min(shard_end, range.local_tf.size());
+            for (size_t word = shard * kShardSize; word < end; ++word)
+            {
+                local_tf[word] += range.local_tf[word];
+            }
+        }
+    });
+    return local_tf;
+}
+
+/*
+ * write vocab.id and vocab.id.txt for words with local tf > 0, in a single
+ * pass over the word ids. Returns the vocab size
+ */
+int32_t write_vocab(const std::string& output_dir, int32_t output_offset,
+    const std::vector<int32_t>& global_tf,
+    const std::vector<int32_t>& local_tf, int64_t block_token_num)
+{
+    int32_t word_num = local_tf.size();
+    std::string vocab_name = output_dir + "/vocab." + std::to_string(output_offset);
+    std::string txt_vocab_name = output_dir + "/vocab." + std::to_string(output_offset) + ".txt";
+
     std::ofstream vocab_file(vocab_name, std::ios::out | std::ios::binary);
-    std::ofstream txt_vocab_file(txt_vocab_name, std::ios::out);
+    std::ofstream txt_vocab_file(txt_vocab_name, std::ios::out | std::ios::binary);
 
     if (!vocab_file.good())
     {
@@ -449,145 +968,363 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
-    block_file.write_empty_header(offset_buf, doc_num);
+    // the words, their global tf and local tf, and the lines of vocab.id.txt
+    std::vector<int32_t> words, word_global_tf, word_local_tf;
+    std::string lines;
+    for (int32_t i = 0; i < word_num; ++i)
+    {
+        if (local_tf[i] > 0)
+        {
+            int32_t tf = (i < global_tf.size()) ? global_tf[i] : 0;
+            words.push_back(i);
+            word_global_tf.push_back(tf);
+            word_local_tf.push_back(local_tf[i]);
+            lines += std::to_string(i);
+            lines += '\t';
+            lines += std::to_string(tf);
+            lines += '\t';
+            lines += std::to_string(local_tf[i]);
+            lines += '\n';
+        }
+    }
+    int32_t vocab_size = static_cast<int32_t>(words.size());
+
+    lightlda::vocab_file_header header = lightlda::new_vocab_header(vocab_size,
+        words.empty() ? -1 : words.back(), block_token_num);
+    vocab_file.write(reinterpret_cast<char*>(&header), sizeof(header));
+    vocab_file.write(reinterpret_cast<char*>(words.data()),
+        sizeof(int32_t)* vocab_size);
+    vocab_file.write(reinterpret_cast<char*>(word_global_tf.data()),
+        sizeof(int32_t)* vocab_size);
+    vocab_file.write(reinterpret_cast<char*>(word_local_tf.data()),
+        sizeof(int32_t)* vocab_size);
+    vocab_file.close();
+
+    std::string size_line = std::to_string(vocab_size) + '\n';
+    txt_vocab_file.write(size_line.data(), size_line.size());
+    txt_vocab_file.write(lines.data(), lines.size());
+    if (!vocab_file.good() || !txt_vocab_file.good())
+    {
+        std::cout << "Fails to write file: " << vocab_name << std::endl;
+        exit(1);
+    }
+    txt_vocab_file.close();
+    return vocab_size;
+}
 
-    int64_t block_token_num = 0;
-    std::string str_line;
+/*
+ * write doc_map.id, line i is the block and the index in the block of the
+ * doc holding the topics of the i-th input doc, the doc itself or the copy
+ * kept for it by -dedup
+ */
+void write_doc_map(const std::string& output_dir, int32_t output_offset,
+    bool one_block, const std::vector<range_dump>& ranges)
+{
+    std::string doc_map_name = output_dir + "/doc_map." + std::to_string(output_offset);
+    std::ofstream doc_map_file(doc_map_name, std::ios::out | std::ios::binary);
+    if (!doc_map_file.good())
+    {
+        std::cout << "Fails to create file: " << doc_map_name << std::endl;
+        exit(1);
+    }
+    // block and index of the first doc of each range
+    std::vector<int32_t> range_block(ranges.size());
+    std::vector<int64_t> range_base(ranges.size(), 0);
+    for (int32_t i = 0; i < ranges.size(); ++i)
+    {
+        range_block[i] = output_offset + (one_block ? 0 : i);
+        if (one_block && i > 0)
+        {
+            range_base[i] = range_base[i - 1] + ranges[i - 1].doc_num;
+        }
+    }
     std::string line;
-    char *endptr = nullptr;
-    const int kBASE = 10;
-    int doc_buf_idx;
+    for (auto& range : ranges)
+    {
+        for (auto& kept : range.kept_docs)
+        {
+            line = std::to_string(range_block[kept.range]) + '\t' +
+                std::to_string(range_base[kept.range] + kept.index) + '\n';
+            doc_map_file.write(line.data(), line.size());
+        }
+    }
+    doc_map_file.close();
+}
 
-    double dump_start = get_time();
+void print_usage()
+{
+    printf("Usage: dump_binary <libsvm_input> <word_dict_file_input> <binary_output_dir> <output_file_offset> [options]\n");
+    printf("  libsvm_input \"-\" reads the standard input with one thread, .gz and\n");
+    printf("  .zst files are read through gzip or zstd. Comma separated files are\n");
+    printf("  dumped in parallel, to one block or to one block per file\n");
+    printf("  word_dict_file_input \"none\" counts the global tf from the input\n");
+    printf("Options:\n");
+    printf("  -num_threads <arg> Number of parsing threads. Default: 1\n");
+    printf("  -num_blocks <arg>  Number of output blocks, numbered from\n");
+    printf("                     output_file_offset. Default: 1\n");
+    printf("  -word_map <arg>    Renumber the words by the word map of remap_vocab\n");
+    printf("  -run_length        Store each distinct word of a doc once with its count\n");
+    printf("  -dedup <arg>       Remove duplicate docs, and near duplicates whose\n");
+    printf("                     SimHash differs in at most arg bits, 0 to 3. A doc\n");
+    printf("                     map to the kept docs is written to doc_map.offset\n");
+    printf("  -benchmark         Only parse the input and print the parsing speed\n");
+}
 
-    offset_buf[0] = 0;
-    for (int64_t j = 0; j < doc_num; ++j)
+int main(int argc, char* argv[])
+{
+    if (argc < 5)
     {
-        if (!libsvm_file.getline(str_line) || str_line.empty())
+        print_usage();
+        exit(1);
+    }
+
+    std::string libsvm_file_name(argv[1]);
+    std::string word_dict_file_name(argv[2]);
+    std::string word_map_file_name;
+    std::string output_dir(argv[3]);
+    int32_t output_offset = atoi(argv[4]);
+    int32_t num_threads = 1;
+    int32_t num_blocks = 1;
+    bool benchmark = false;
+    bool run_length = false;
+    int32_t dedup_distance = -1;
+    for (int i = 5; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-benchmark") == 0) benchmark = true;
+        else if (strcmp(argv[i], "-run_length") == 0) run_length = true;
+        else if (strcmp(argv[i], "-num_threads") == 0 && i + 1 < argc) num_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-num_blocks") == 0 && i + 1 < argc) num_blocks = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-word_map") == 0 && i + 1 < argc) word_map_file_name = argv[++i];
+        else if (strcmp(argv[i], "-dedup") == 0 && i + 1 < argc) dedup_distance = atoi(argv[++i]);
+        else
         {
-            std::cout << "Fails to get line" << std::endl;
+            print_usage();
             exit(1);
         }
-        str_line += '\n';
-
-        std::vector<std::string> output;
-        split_string(str_line, '\t', output);
-
+    }
+    if (num_threads <= 0 || num_blocks <= 0 || dedup_distance > 3)
+    {
+        print_usage();
+        exit(1);
+    }
 
-        if (output.size() != 2)
+    // split the input into line aligned byte ranges, one per thread for one
+    // output block, or one per output block. Several input files, or a
+    // stream input, give one range per file
+    int32_t num_ranges = (num_blocks == 1 || benchmark) ? num_threads : num_blocks;
+    std::vector<range_dump> ranges = split_inputs(libsvm_file_name, num_ranges);
+    if (ranges.size() != num_ranges)
+    {
+        if (num_blocks != 1 && num_blocks != ranges.size())
         {
-            std::cout << "Invalid format, not key TAB val: " << str_line << std::endl;
+            std::cout << "Stream inputs and several input files can only be dumped "
+                "to one block, or to one block per file" << std::endl;
             exit(1);
         }
+        num_ranges = static_cast<int32_t>(ranges.size());
+    }
 
-        int doc_token_count = 0;
-        std::vector<Token> doc_tokens;
+    if (benchmark)
+    {
+        double parse_start = get_time();
+        lightlda::parallel_for(num_ranges, num_threads, [&](int32_t i)
+        {
+            parse_range(ranges[i]);
+        });
+        int64_t bytes = 0, doc_num = 0, token_num = 0;
+        for (auto& range : ranges)
+        {
+            bytes += range.bytes;
+            doc_num += range.doc_num;
+            token_num += range.token_num;
+        }
+        double seconds = get_time() - parse_start;
+        std::cout << "Parsed " << doc_num << " docs, " << token_num << " tokens in "
+            << seconds << " seconds" << std::endl;
+        std::cout << "Parse throughput with " << num_threads << " threads: "
+            << bytes / 1024.0 / 1024.0 / seconds << " MB/s, "
+            << token_num / seconds << " tokens/s" << std::endl;
+        return 0;
+    }
 
-        char *ptr = &(output[1][0]);
+    // 1. load the word_dict file, get the global {word_id, tf} mapping.
+    // With word dict "none", the global tf is counted from the input itself
+    std::vector<int32_t> global_tf;
+    int64_t global_tf_count = 0;
+    int32_t word_num = 0;
+    bool count_global_tf = (word_dict_file_name == "none");
+    if (!count_global_tf)
+    {
+        int32_t dict_size = 0;
+        load_global_tf(global_tf, word_dict_file_name, global_tf_count, dict_size);
+        word_num = global_tf.size();
+        std::cout << "There are totally " << dict_size
+            << " words in the vocabulary" << std::endl;
+        std::cout << "There are maximally totally " << global_tf_count
+            << " tokens in the data set" << std::endl;
+    }
 
-        while (*ptr != '\n')
+    // word ids of the input are renumbered by the word map of remap_vocab
+    std::vector<int32_t> old_to_new;
+    if (!word_map_file_name.empty())
+    {
+        std::vector<int32_t> new_to_old;
+        if (!lightlda::read_word_map(word_map_file_name, new_to_old) ||
+            !lightlda::invert_word_map(new_to_old, old_to_new))
         {
-            if (doc_token_count >= kMaxDocLength) break;
-            // read a word_id:count pair
-            int32_t word_id = strtol(ptr, &endptr, kBASE);
-            ptr = endptr;
-            if (':' != *ptr)
-            {
-                std::cout << "Invalid input" << str_line << std::endl;
-                exit(1);
-            }
-            int32_t count = strtol(++ptr, &endptr, kBASE);
-
-            ptr = endptr;
-            for (int k = 0; k < count; ++k)
+            std::cout << "Invalid word map file: " << word_map_file_name << std::endl;
+            exit(1);
+        }
+        if (!count_global_tf)
+        {
+            std::vector<int32_t> new_tf(new_to_old.size(), 0);
+            for (int32_t word = 0; word < global_tf.size(); ++word)
             {
-                doc_tokens.push_back({ word_id, 0 });
-                if (local_tf_map.find(word_id) == local_tf_map.end())
+                if (global_tf[word] == 0)
                 {
-                    local_tf_map.insert(std::make_pair(word_id, 1));
+                    continue;
                 }
-                else
+                if (word >= old_to_new.size() || old_to_new[word] < 0)
                 {
-                    local_tf_map[word_id]++;
+                    std::cout << "Word id not in word map: " << word << std::endl;
+                    exit(1);
                 }
-                ++block_token_num;
-                ++doc_token_count;
-                if (doc_token_count >= kMaxDocLength) break;
+                new_tf[old_to_new[word]] = global_tf[word];
             }
-            while (*ptr == ' ' || *ptr == '\r') ++ptr;
-        }
-        // The input data may be already sorted
-        std::sort(doc_tokens.begin(), doc_tokens.end(), Compare);
-
-        doc_buf_idx = 0;
-        doc_buf[doc_buf_idx++] = 0; // cursor
-
-        for (auto& token : doc_tokens)
-        {
-            doc_buf[doc_buf_idx++] = token.word_id;
-            doc_buf[doc_buf_idx++] = token.topic_id;
+            global_tf.swap(new_tf);
         }
-
-        block_file.write_doc(doc_buf, doc_buf_idx);
-        offset_buf[j + 1] = offset_buf[j] + doc_buf_idx;
+        word_num = new_to_old.size();
     }
-    block_file.write_real_header(offset_buf, doc_num);
 
-    int32_t vocab_size = 0;
+    double dump_start = get_time();
 
-    vocab_file.write(reinterpret_cast<char*>(&vocab_size), sizeof(int32_t));
+    // 2. name the output of ranges, parts of one block or blocks
+    std::vector<std::string> block_names(num_ranges);
+    for (int32_t i = 0; i < num_ranges; ++i)
+    {
+        block_names[i] = (num_blocks == 1) ?
+            output_dir + "/block." + std::to_string(output_offset) + ".part" + std::to_string(i) :
+            output_dir + "/block." + std::to_string(output_offset + i);
+    }
+    if (num_ranges == 1)
+    {
+        block_names[0] = output_dir + "/block." + std::to_string(output_offset);
+    }
 
-    int32_t non_zero_count = 0;
-    // write vocab
-    for (int i = 0; i < word_num; ++i)
+    // 3. transform the libsvm -> binary block, range by range in parallel.
+    // With -dedup and several ranges, duplicates are found before dumping
+    std::unique_ptr<lightlda::doc_dedup> dedup;
+    if (dedup_distance >= 0)
     {
-        if (local_tf_map[i] > 0)
+        dedup.reset(new lightlda::doc_dedup(dedup_distance));
+        if (num_ranges > 1)
         {
-            non_zero_count++;
-            vocab_file.write(reinterpret_cast<char*> (&i), sizeof(int32_t));
+            find_duplicates(word_num, old_to_new, *dedup, ranges, num_threads);
         }
     }
-    std::cout << "The number of tokens in the output block is: " << block_token_num << std::endl;
-    std::cout << "Local vocab_size for the output block is: " << non_zero_count << std::endl;
-
-    // write global tf
-    for (int i = 0; i < word_num; ++i)
+    lightlda::parallel_for(num_ranges, num_threads, [&](int32_t i)
+    {
+        dump_range(word_num, old_to_new, run_length,
+            num_ranges == 1 ? dedup.get() : nullptr, i, block_names[i],
+            num_blocks != 1 || num_ranges == 1, ranges[i]);
+    });
+
+    // 4. write blocks and vocabs
+    std::vector<int32_t> block_local_tf;
+    if (num_blocks == 1)
+    {
+        block_local_tf = sum_local_tf(ranges, num_threads);
+    }
+    if (count_global_tf)
     {
-        if (local_tf_map[i] > 0)
+        if (num_blocks == 1)
         {
-            vocab_file.write(reinterpret_cast<char*> (&global_tf_map[i]), sizeof(int32_t));
+            global_tf = block_local_tf;
         }
+        else
+        {
+            global_tf = sum_local_tf(ranges, num_threads);
+        }
+        int32_t vocab_size = 0;
+        for (auto tf : global_tf)
+        {
+            vocab_size += (tf > 0);
+            global_tf_count += tf;
+        }
+        std::cout << "There are totally " << vocab_size
+            << " words and " << global_tf_count << " tokens in the data set" << std::endl;
     }
-    // write local tf
-    for (int i = 0; i < word_num; ++i)
+    std::vector<int64_t> block_token_num(num_blocks, 0);
+    std::vector<int32_t> vocab_size(num_blocks, 0);
+    if (num_blocks == 1)
     {
-        if (local_tf_map[i] > 0)
+        if (num_ranges > 1)
         {
-            vocab_file.write(reinterpret_cast<char*> (&local_tf_map[i]), sizeof(int32_t));
+            merge_ranges(ranges, block_names,
+                output_dir + "/block." + std::to_string(output_offset),
+                run_length ? lightlda::kRunLengthLayout : lightlda::kInterleavedLayout,
+                num_threads);
         }
+        for (auto& range : ranges)
+        {
+            block_token_num[0] += range.token_num;
+        }
+        vocab_size[0] = write_vocab(output_dir, output_offset, global_tf,
+            block_local_tf, block_token_num[0]);
     }
-    vocab_file.seekp(0);
-    vocab_file.write(reinterpret_cast<char*>(&non_zero_count), sizeof(int32_t));
-    vocab_file.close();
-
-    txt_vocab_file << non_zero_count << std::endl;
-    for (int i = 0; i < word_num; ++i)
+    else
+    {
+        // the vocabs of blocks are written in parallel
+        lightlda::parallel_for(num_blocks, num_threads, [&](int32_t i)
+        {
+            block_token_num[i] = ranges[i].token_num;
+            vocab_size[i] = write_vocab(output_dir, output_offset + i,
+                global_tf, ranges[i].local_tf, block_token_num[i]);
+        });
+    }
+    for (int32_t i = 0; i < num_blocks; ++i)
+    {
+        std::cout << "The number of tokens in the output block " << output_offset + i
+            << " is: " << block_token_num[i] << std::endl;
+        std::cout << "Local vocab_size for the output block " << output_offset + i
+            << " is: " << vocab_size[i] << std::endl;
+    }
+    if (dedup)
     {
-        if (local_tf_map[i] > 0)
+        write_doc_map(output_dir, output_offset, num_blocks == 1, ranges);
+        int64_t dup_doc_num = 0, dup_token_num = 0, token_num = 0;
+        for (auto& range : ranges)
         {
-            txt_vocab_file << i << "\t" << global_tf_map[i] << "\t" << local_tf_map[i] << std::endl;
+            dup_doc_num += range.dup_doc_num;
+            dup_token_num += range.dup_token_num;
+            token_num += range.token_num + range.dup_token_num;
         }
+        std::cout << "Removed " << dup_doc_num << " duplicate docs with " << dup_token_num
+            << " tokens, " << 100.0 * dup_token_num / std::max<int64_t>(token_num, 1)
+            << "% of tokens" << std::endl;
     }
-    txt_vocab_file.close();
 
     double dump_end = get_time();
+    int64_t input_bytes = 0;
+    for (auto& range : ranges)
+    {
+        input_bytes += range.bytes;
+    }
+    double input_mb = input_bytes / 1024.0 / 1024.0;
     std::cout << "Elapsed seconds for dump blocks: " << (dump_end - dump_start) << std::endl;
-
-    // close file and release resource
-    libsvm_file.close();
-    block_file.close();
-
-    delete[]offset_buf;
-    delete[]doc_buf;
+    std::cout << "Dump throughput with " << num_threads << " threads: "
+        << input_mb / (dump_end - dump_start) << " MB/s" << std::endl;
+    if (run_length)
+    {
+        // a doc takes a cursor and 2 int32 per token in the plain layout
+        int64_t corpus_size = 0, plain_size = 0;
+        for (auto& range : ranges)
+        {
+            corpus_size += range.corpus_size;
+            plain_size += range.doc_num + 2 * range.token_num;
+        }
+        std::cout << "Run-length layout takes " << 100.0 * corpus_size / std::max<int64_t>(plain_size, 1)
+            << "% of the documents size in the plain layout" << std::endl;
+    }
     return 0;
 }
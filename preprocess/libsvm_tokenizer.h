@@ -0,0 +1,176 @@
+/*!
+ * \file libsvm_tokenizer.h
+ * \brief Zero-allocation tokenizer of libsvm lines, shared by the
+ *  preprocessing tools. A line is "key TAB word:count word:count ...".
+ *  Newlines and separators are searched 16 bytes at a time with SSE2,
+ *  numbers up to 8 digits are parsed 8 bytes at a time within a 64 bit
+ *  word (SWAR). Both fall back to scalar code near the end of a line and
+ *  on platforms without SSE2.
+ */
+
+#ifndef LIGHTLDA_LIBSVM_TOKENIZER_H_
+#define LIGHTLDA_LIBSVM_TOKENIZER_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHTLDA_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace lightlda
+{
+    /*! \brief index of the lowest set bit, x should not be 0 */
+    inline int32_t lowest_bit(uint64_t x)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, x);
+        return static_cast<int32_t>(index);
+#else
+        return __builtin_ctzll(x);
+#endif
+    }
+
+    /*! \brief first c in [begin, end), or nullptr if not found */
+    inline const char* find_char(const char* begin, const char* end, char c)
+    {
+#ifdef LIGHTLDA_USE_SSE2
+        const __m128i pattern = _mm_set1_epi8(c);
+        for (; begin + 16 <= end; begin += 16)
+        {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, pattern));
+            if (mask != 0)
+            {
+                return begin + lowest_bit(mask);
+            }
+        }
+#endif
+        for (; begin < end; ++begin)
+        {
+            if (*begin == c) return begin;
+        }
+        return nullptr;
+    }
+
+    /*!
+     * \brief parses the decimal number at ptr, no sign is accepted.
+     *  Returns false if there is no digit. ptr is moved after the digits
+     */
+    inline bool parse_uint(const char*& ptr, const char* end, int32_t& value)
+    {
+        const uint64_t kLowBits = 0x7F7F7F7F7F7F7F7FULL;
+        const uint64_t kHighBits = 0x8080808080808080ULL;
+        if (ptr + 8 <= end)
+        {
+            uint64_t chunk;
+            memcpy(&chunk, ptr, 8);
+            // digit bytes become 0..9, a byte is a non-digit iff it is >= 10
+            uint64_t digits = chunk ^ 0x3030303030303030ULL;
+            uint64_t non_digit = (((digits & kLowBits) + 0x7676767676767676ULL)
+                | digits) & kHighBits;
+            if (non_digit != 0)
+            {
+                // bytes are little endian, the first non-digit is the lowest
+                int32_t len = lowest_bit(non_digit) / 8;
+                if (len == 0)
+                {
+                    return false;
+                }
+                // align the digits to the high end, leading bytes become 0
+                digits <<= 8 * (8 - len);
+                digits = (digits * 10 + (digits >> 8)) & 0x00FF00FF00FF00FFULL;
+                digits = (digits * 100 + (digits >> 16)) & 0x0000FFFF0000FFFFULL;
+                digits = (digits * 10000 + (digits >> 32)) & 0x00000000FFFFFFFFULL;
+                value = static_cast<int32_t>(digits);
+                ptr += len;
+                return true;
+            }
+        }
+        // near the end of line, or more than 8 digits
+        const char* begin = ptr;
+        int64_t result = 0;
+        while (ptr < end && *ptr >= '0' && *ptr <= '9')
+        {
+            result = result * 10 + (*ptr - '0');
+            ++ptr;
+        }
+        value = static_cast<int32_t>(result);
+        return ptr != begin && result <= INT32_MAX;
+    }
+
+    /*!
+     * \brief parses a libsvm line without the ending '\n', calling
+     *  on_pair(word, count) for each word:count pair. on_pair returns
+     *  false to stop parsing the rest of the line.
+     * \return false if the line is not in libsvm format
+     */
+    template <typename Func>
+    inline bool parse_libsvm(const char* begin, const char* end, Func on_pair)
+    {
+        const char* ptr = find_char(begin, end, '\t');
+        if (ptr == nullptr)
+        {
+            return false;
+        }
+        ++ptr;
+        int32_t word = 0, count = 0;
+        while (ptr < end)
+        {
+            while (ptr < end && (*ptr == ' ' || *ptr == '\r')) ++ptr;
+            if (ptr == end)
+            {
+                break;
+            }
+            // read a word_id:count pair
+            if (!parse_uint(ptr, end, word) || ptr == end || *ptr != ':')
+            {
+                return false;
+            }
+            ++ptr;
+            if (!parse_uint(ptr, end, count))
+            {
+                return false;
+            }
+            if (ptr < end && *ptr != ' ' && *ptr != '\r')
+            {
+                return false;
+            }
+            if (!on_pair(word, count))
+            {
+                break;
+            }
+        }
+        return true;
+    }
+
+    /*!
+     * \brief parses a libsvm line without the ending '\n' into words,
+     *  each repeated by its count. Parsing stops at max_doc_length tokens.
+     *  words is cleared but keeps its memory, so no allocation happens
+     *  once it is large enough.
+     * \return false if the line is not in libsvm format
+     */
+    inline bool tokenize_libsvm(const char* begin, const char* end,
+        int32_t max_doc_length, std::vector<int32_t>& words)
+    {
+        words.clear();
+        return parse_libsvm(begin, end, [&](int32_t word, int32_t count)
+        {
+            count = std::min<int32_t>(count,
+                max_doc_length - static_cast<int32_t>(words.size()));
+            words.insert(words.end(), count, word);
+            return words.size() < max_doc_length;
+        });
+    }
+}
+
+#endif // LIGHTLDA_LIBSVM_TOKENIZER_H_
@@ -0,0 +1,43 @@
+/*!
+ * \file parallel_for.h
+ * \brief Thread pool loop shared by the preprocessing tools
+ */
+
+#ifndef LIGHTLDA_PARALLEL_FOR_H_
+#define LIGHTLDA_PARALLEL_FOR_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace lightlda
+{
+    /*!
+     * \brief runs func(0) ... func(count - 1) on num_threads threads, each
+     *  thread takes the next index when done with the previous one
+     */
+    template <typename Func>
+    void parallel_for(int32_t count, int32_t num_threads, Func func)
+    {
+        std::atomic<int32_t> next(0);
+        std::vector<std::thread> threads;
+        for (int32_t t = 0; t < std::min(num_threads, count); ++t)
+        {
+            threads.push_back(std::thread([&]()
+            {
+                for (int32_t i = next++; i < count; i = next++)
+                {
+                    func(i);
+                }
+            }));
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+}
+
+#endif // LIGHTLDA_PARALLEL_FOR_H_
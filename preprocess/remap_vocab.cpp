@@ -0,0 +1,195 @@
+/*!
+ * \file remap_vocab.cpp
+ * \brief Preprocessing tool for renumbering words by descending term
+ *  frequency, so that frequent words, with dense rows in the word-topic
+ *  table, get the small ids and are scheduled together in the first
+ *  model slices.
+ *  Usage:
+ *    remap_vocab build <word_dict_file_input> <word_map_output>
+ *      Writes the word map of the words in the dict, the input of
+ *      dump_binary -word_map
+ *    remap_vocab restore <word_map_input> <input> <output>
+ *      Maps the word id at the beginning of each line back to the word id
+ *      of the dict, for the model files dumped by LightLDA
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "libsvm_tokenizer.h"
+#include "utf8_stream.h"
+#include "word_map.h"
+
+namespace lightlda
+{
+    struct word_tf
+    {
+        int32_t word;
+        int64_t tf;
+    };
+
+    /*! \brief reads the word_id TAB word TAB tf lines of the dict */
+    std::vector<word_tf> read_dict(const std::string& file_name)
+    {
+        utf8_stream stream(1024 * 1024 * 16);
+        if (!stream.open(file_name))
+        {
+            std::cout << "Fails to open file: " << file_name << std::endl;
+            exit(1);
+        }
+        std::vector<word_tf> dict;
+        std::string line;
+        while (stream.getline(line))
+        {
+            size_t first = line.find('\t');
+            size_t last = line.rfind('\t');
+            if (first == std::string::npos || first == last)
+            {
+                std::cout << "Invalid line: " << line << std::endl;
+                exit(1);
+            }
+            word_tf entry;
+            entry.word = std::stoi(line.substr(0, first));
+            entry.tf = std::stoll(line.substr(last + 1));
+            dict.push_back(entry);
+        }
+        stream.close();
+        return dict;
+    }
+
+    void build(const std::string& dict_name, const std::string& word_map_name)
+    {
+        std::vector<word_tf> dict = read_dict(dict_name);
+        // checked before the sort, which puts apart the lines of a word
+        // with different tf
+        std::vector<bool> seen;
+        for (auto& entry : dict)
+        {
+            if (entry.word < 0)
+            {
+                std::cout << "Invalid word id: " << entry.word << std::endl;
+                exit(1);
+            }
+            if (entry.word >= seen.size())
+            {
+                seen.resize(entry.word + 1, false);
+            }
+            if (seen[entry.word])
+            {
+                std::cout << "Duplicate words detected: " << entry.word << std::endl;
+                exit(1);
+            }
+            seen[entry.word] = true;
+        }
+        // ties are broken by the old id, so that the map is deterministic
+        std::sort(dict.begin(), dict.end(), [](const word_tf& a, const word_tf& b)
+        {
+            return a.tf > b.tf || (a.tf == b.tf && a.word < b.word);
+        });
+
+        std::ofstream word_map_file(word_map_name, std::ios::out | std::ios::binary);
+        if (!word_map_file.good())
+        {
+            std::cout << "Fails to create file: " << word_map_name << std::endl;
+            exit(1);
+        }
+        int64_t token_num = 0;
+        for (int32_t new_id = 0; new_id < dict.size(); ++new_id)
+        {
+            word_map_file << new_id << '\t' << dict[new_id].word << '\n';
+            token_num += dict[new_id].tf;
+        }
+        word_map_file.close();
+
+        // how the tokens concentrate on the first ids
+        std::cout << "There are totally " << dict.size() << " words and "
+            << token_num << " tokens" << std::endl;
+        int64_t covered = 0;
+        int32_t new_id = 0;
+        for (double ratio : { 0.001, 0.01, 0.1, 0.5 })
+        {
+            for (; new_id < dict.size() * ratio; ++new_id)
+            {
+                covered += dict[new_id].tf;
+            }
+            printf("The first %d words (%g%%) cover %.2f%% of tokens\n", new_id,
+                ratio * 100, token_num > 0 ? 100.0 * covered / token_num : 0.0);
+        }
+    }
+
+    void restore(const std::string& word_map_name, const std::string& input_name,
+        const std::string& output_name)
+    {
+        std::vector<int32_t> new_to_old;
+        if (!read_word_map(word_map_name, new_to_old))
+        {
+            std::cout << "Invalid word map file: " << word_map_name << std::endl;
+            exit(1);
+        }
+        utf8_stream input(1024 * 1024 * 64);
+        if (!input.open(input_name))
+        {
+            std::cout << "Fails to open file: " << input_name << std::endl;
+            exit(1);
+        }
+        std::ofstream output(output_name, std::ios::out | std::ios::binary);
+        if (!output.good())
+        {
+            std::cout << "Fails to create file: " << output_name << std::endl;
+            exit(1);
+        }
+        const char* line_begin = nullptr;
+        const char* line_end = nullptr;
+        std::string old_id;
+        while (input.getline(line_begin, line_end))
+        {
+            const char* ptr = line_begin;
+            int32_t new_id;
+            if (!parse_uint(ptr, line_end, new_id) || new_id >= new_to_old.size())
+            {
+                std::cout << "Word id not in word map: "
+                    << std::string(line_begin, line_end) << std::endl;
+                exit(1);
+            }
+            old_id = std::to_string(new_to_old[new_id]);
+            output.write(old_id.data(), old_id.size());
+            output.write(ptr, line_end - ptr);
+            output.put('\n');
+        }
+        input.close();
+        output.close();
+    }
+}
+
+void print_usage()
+{
+    printf("Usage:\n");
+    printf("  remap_vocab build <word_dict_file_input> <word_map_output>\n");
+    printf("    Renumbers the words of the dict by descending term frequency\n");
+    printf("  remap_vocab restore <word_map_input> <input> <output>\n");
+    printf("    Maps the word id at the beginning of each line back\n");
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 4 && strcmp(argv[1], "build") == 0)
+    {
+        lightlda::build(argv[2], argv[3]);
+    }
+    else if (argc == 5 && strcmp(argv[1], "restore") == 0)
+    {
+        lightlda::restore(argv[2], argv[3], argv[4]);
+    }
+    else
+    {
+        print_usage();
+        exit(1);
+    }
+    return 0;
+}
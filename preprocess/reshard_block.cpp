@@ -0,0 +1,526 @@
+/*!
+ * \file reshard_block.cpp
+ * \brief Preprocessing tool for re-sharding LightLDA binary blocks into
+ *  blocks with balanced number of tokens
+ *  Usage:
+ *    reshard_block <input_dir> <num_input_blocks> <output_dir> [options]
+ *  Options:
+ *    -num_blocks <arg>  Min number of output blocks. Default: 1
+ *    -block_size <arg>  Max size(MB) of an output block. Default: 1024
+ *    -num_threads <arg> Number of threads. Default: 4
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "block_format.h"
+#include "parallel_for.h"
+
+namespace lightlda
+{
+    /*
+     * Input blocks and vocabs are in any of the formats of block_format.h,
+     * each doc being a cursor and the word-topic pairs(int32). Blocks in
+     * the run-length layout of dump_binary -run_length are not supported.
+     * Output blocks and vocabs are of version 1.
+     *
+     * The tool reads only the offsets of the input blocks to plan the
+     * output blocks, then each output block is written by one thread,
+     * which streams its documents from the input blocks with a bounded
+     * buffer. The whole corpus is never held in memory.
+     */
+
+    /*! \brief offsets of an input block */
+    struct block_header
+    {
+        int64_t doc_num;
+        std::vector<int64_t> offsets;
+        /*! \brief file position of the first document */
+        int64_t data_begin;
+    };
+
+    /*! \brief documents [doc_begin, doc_end) of an input block */
+    struct doc_range
+    {
+        int32_t block;
+        int64_t doc_begin;
+        int64_t doc_end;
+    };
+
+    /*! \brief an output block, made of ranges of input blocks */
+    struct output_plan
+    {
+        std::vector<doc_range> ranges;
+        int64_t doc_num = 0;
+        int64_t token_num = 0;
+        int64_t corpus_size = 0;
+    };
+
+    bool read_header(const std::string& file_name, block_header& header)
+    {
+        std::ifstream stream(file_name, std::ios::in | std::ios::binary);
+        if (!stream.good())
+        {
+            return false;
+        }
+        int64_t head = 0;
+        stream.read(reinterpret_cast<char*>(&head), sizeof(int64_t));
+        block_file_header file_header;
+        if (head == kBlockHeaderMagic)
+        {
+            stream.seekg(0);
+            stream.read(reinterpret_cast<char*>(&file_header), sizeof(file_header));
+            if (!stream.good() || file_header.byte_order != kByteOrderMark ||
+                file_header.version > kFormatVersion)
+            {
+                return false;
+            }
+        }
+        if (head == kBlockHeaderMagic && file_header.layout != kInterleavedLayout)
+        {
+            // the token number of a doc is not known from its offsets
+            std::cout << "Blocks in run-length layout are not supported: "
+                << file_name << std::endl;
+            exit(1);
+        }
+        if (head == kBlockHeaderMagic)
+        {
+            header.doc_num = file_header.doc_num;
+            header.data_begin = sizeof(block_file_header);
+            stream.seekg(header.data_begin + sizeof(int32_t)* file_header.corpus_size);
+        }
+        else if (head >= 0)
+        {
+            header.doc_num = head;
+            header.data_begin = sizeof(int64_t)* (header.doc_num + 2);
+        }
+        else
+        {
+            // kIncompleteMagic or unknown
+            return false;
+        }
+        header.offsets.resize(header.doc_num + 1);
+        stream.read(reinterpret_cast<char*>(header.offsets.data()),
+            sizeof(int64_t)* (header.doc_num + 1));
+        return stream.good();
+    }
+
+    /*! \brief merges global tf of a vocab file, global tf is the max seen */
+    bool read_global_tf(const std::string& file_name,
+        std::vector<int32_t>& global_tf)
+    {
+        std::ifstream stream(file_name, std::ios::in | std::ios::binary);
+        if (!stream.good())
+        {
+            return false;
+        }
+        vocab_file_header header;
+        stream.read(reinterpret_cast<char*>(&header.magic), sizeof(int64_t));
+        if (stream.good() && header.magic == kVocabHeaderMagic)
+        {
+            stream.read(reinterpret_cast<char*>(&header) + sizeof(int64_t),
+                sizeof(header) - sizeof(int64_t));
+            if (header.byte_order != kByteOrderMark || header.version > kFormatVersion)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            // vocab files without header start with the size
+            stream.clear();
+            stream.seekg(0);
+            stream.read(reinterpret_cast<char*>(&header.size), sizeof(int32_t));
+        }
+        int32_t vocab_size = header.size;
+        std::vector<int32_t> buf(vocab_size * 2);
+        stream.read(reinterpret_cast<char*>(buf.data()),
+            sizeof(int32_t)* vocab_size * 2);
+        if (!stream.good())
+        {
+            return false;
+        }
+        for (int32_t i = 0; i < vocab_size; ++i)
+        {
+            int32_t word = buf[i];
+            if (word >= global_tf.size())
+            {
+                global_tf.resize(word + 1, 0);
+            }
+            global_tf[word] = std::max(global_tf[word], buf[vocab_size + i]);
+        }
+        return true;
+    }
+
+    int64_t block_byte_size(const output_plan& plan)
+    {
+        return sizeof(block_file_header) + sizeof(int64_t)* (plan.doc_num + 1) +
+            sizeof(int32_t)* plan.corpus_size;
+    }
+
+    /*!
+     * \brief Splits the documents of all input blocks into at least
+     *  num_blocks output blocks of about the same number of tokens, in input
+     *  order. Each block aims at the tokens left over the blocks left, takes
+     *  at least one document and at most block_size bytes, so no block is
+     *  empty and a block is added only when the previous one is full.
+     *  num_blocks should not exceed the number of documents, and every
+     *  document should fit in a block of block_size bytes
+     */
+    std::vector<output_plan> plan_blocks(
+        const std::vector<block_header>& headers, int64_t total_doc_num,
+        int64_t total_token_num, int32_t num_blocks, int64_t block_size)
+    {
+        std::vector<output_plan> plans(1);
+        int64_t doc_left = total_doc_num;
+        int64_t token_left = total_token_num;
+        int64_t target = token_left / num_blocks;
+        for (int32_t b = 0; b < headers.size(); ++b)
+        {
+            const std::vector<int64_t>& offsets = headers[b].offsets;
+            for (int64_t d = 0; d < headers[b].doc_num; ++d)
+            {
+                int64_t doc_size = offsets[d + 1] - offsets[d];
+                int64_t doc_token_num = (doc_size - 1) / 2;
+                output_plan* plan = &plans.back();
+                int64_t block_left = num_blocks - static_cast<int64_t>(plans.size());
+                // Moves to the next block when this one reached its share,
+                // when each of the blocks left needs one of the docs left,
+                // or when this doc does not fit in this one
+                if (plan->doc_num > 0 && ((block_left > 0 &&
+                    (plan->token_num >= target || doc_left <= block_left)) ||
+                    block_byte_size(*plan) + sizeof(int64_t) +
+                    sizeof(int32_t)* doc_size > block_size))
+                {
+                    plans.emplace_back();
+                    plan = &plans.back();
+                    target = token_left / std::max<int64_t>(block_left, 1);
+                }
+                if (plan->ranges.empty() || plan->ranges.back().block != b)
+                {
+                    plan->ranges.push_back({ b, d, d });
+                }
+                plan->ranges.back().doc_end = d + 1;
+                plan->doc_num += 1;
+                plan->token_num += doc_token_num;
+                plan->corpus_size += doc_size;
+                doc_left -= 1;
+                token_left -= doc_token_num;
+            }
+        }
+        return plans;
+    }
+
+    /*!
+     * \brief Writes an output block and its vocab, documents are copied
+     *  from input in batches of at most kBufferSize int32
+     */
+    void write_block(const std::string& input_dir,
+        const std::vector<block_header>& headers,
+        const output_plan& plan,
+        const std::vector<int32_t>& global_tf,
+        const std::string& output_dir, int32_t output_id)
+    {
+        const int64_t kBufferSize = 1024 * 1024 * 16;
+
+        std::string block_name = output_dir + "/block." + std::to_string(output_id);
+        std::string vocab_name = output_dir + "/vocab." + std::to_string(output_id);
+        std::string txt_vocab_name = vocab_name + ".txt";
+
+        // files are written under temporary names and renamed when complete,
+        // so a crash never leaves a partial block or vocab in output_dir
+        std::ofstream block_file(block_name + ".temp", std::ios::out | std::ios::binary);
+        if (!block_file.good())
+        {
+            std::cout << "Fails to create file: " << block_name << ".temp" << std::endl;
+            exit(1);
+        }
+
+        // The offsets are known from the plan, so the header goes first
+        block_file_header file_header = new_block_header(kInterleavedLayout);
+        std::vector<int64_t> offsets;
+        offsets.reserve(plan.doc_num + 1);
+        offsets.push_back(0);
+        for (auto& range : plan.ranges)
+        {
+            const std::vector<int64_t>& input_offsets = headers[range.block].offsets;
+            for (int64_t d = range.doc_begin; d < range.doc_end; ++d)
+            {
+                int64_t size = input_offsets[d + 1] - input_offsets[d];
+                add_doc(file_header, (size - 1) / 2, size);
+                offsets.push_back(offsets.back() + size);
+            }
+        }
+        block_file.write(reinterpret_cast<char*>(&file_header), sizeof(file_header));
+
+        std::vector<int32_t> local_tf(global_tf.size(), 0);
+        std::vector<int32_t> buffer;
+        for (auto& range : plan.ranges)
+        {
+            const block_header& header = headers[range.block];
+            std::string input_name = input_dir + "/block." + std::to_string(range.block);
+            std::ifstream input_file(input_name, std::ios::in | std::ios::binary);
+            if (!input_file.good())
+            {
+                std::cout << "Fails to open file: " << input_name << std::endl;
+                exit(1);
+            }
+            input_file.seekg(header.data_begin +
+                sizeof(int32_t)* header.offsets[range.doc_begin]);
+
+            int64_t doc_begin = range.doc_begin;
+            while (doc_begin < range.doc_end)
+            {
+                // A batch holds whole documents, at least one
+                int64_t doc_end = doc_begin + 1;
+                while (doc_end < range.doc_end &&
+                    header.offsets[doc_end + 1] - header.offsets[doc_begin] <= kBufferSize)
+                {
+                    ++doc_end;
+                }
+                int64_t base = header.offsets[doc_begin];
+                int64_t size = header.offsets[doc_end] - base;
+                buffer.resize(size);
+                input_file.read(reinterpret_cast<char*>(buffer.data()),
+                    sizeof(int32_t)* size);
+                if (!input_file.good())
+                {
+                    std::cout << "Fails to read file: " << input_name << std::endl;
+                    exit(1);
+                }
+                for (int64_t d = doc_begin; d < doc_end; ++d)
+                {
+                    // skip the cursor, then the word of each word-topic pair
+                    for (int64_t i = header.offsets[d] - base + 1;
+                        i < header.offsets[d + 1] - base; i += 2)
+                    {
+                        int32_t word = buffer[i];
+                        if (word < 0 || word >= local_tf.size())
+                        {
+                            std::cout << "Word " << word << " in " << input_name
+                                << " is not in vocab files" << std::endl;
+                            exit(1);
+                        }
+                        ++local_tf[word];
+                    }
+                }
+                block_file.write(reinterpret_cast<char*>(buffer.data()),
+                    sizeof(int32_t)* size);
+                doc_begin = doc_end;
+            }
+        }
+        block_file.write(reinterpret_cast<char*>(offsets.data()),
+            sizeof(int64_t)* offsets.size());
+        block_file.close();
+        if (!block_file.good() || !move_file(block_name + ".temp", block_name))
+        {
+            std::cout << "Fails to write file: " << block_name << std::endl;
+            exit(1);
+        }
+
+        std::vector<int32_t> words;
+        for (int32_t word = 0; word < local_tf.size(); ++word)
+        {
+            if (local_tf[word] > 0)
+            {
+                words.push_back(word);
+            }
+        }
+        int32_t vocab_size = static_cast<int32_t>(words.size());
+        std::ofstream vocab_file(vocab_name + ".temp", std::ios::out | std::ios::binary);
+        std::ofstream txt_vocab_file(txt_vocab_name + ".temp", std::ios::out);
+        if (!vocab_file.good() || !txt_vocab_file.good())
+        {
+            std::cout << "Fails to create file: " << vocab_name << std::endl;
+            exit(1);
+        }
+        vocab_file_header vocab_header = new_vocab_header(vocab_size,
+            words.empty() ? -1 : words.back(), file_header.token_num);
+        vocab_file.write(reinterpret_cast<char*>(&vocab_header), sizeof(vocab_header));
+        vocab_file.write(reinterpret_cast<char*>(words.data()),
+            sizeof(int32_t)* vocab_size);
+        for (auto word : words)
+        {
+            vocab_file.write(reinterpret_cast<const char*>(&global_tf[word]),
+                sizeof(int32_t));
+        }
+        for (auto word : words)
+        {
+            vocab_file.write(reinterpret_cast<char*>(&local_tf[word]),
+                sizeof(int32_t));
+        }
+        vocab_file.close();
+
+        txt_vocab_file << vocab_size << std::endl;
+        for (auto word : words)
+        {
+            txt_vocab_file << word << "\t" << global_tf[word] << "\t"
+                << local_tf[word] << std::endl;
+        }
+        txt_vocab_file.close();
+        if (!vocab_file.good() || !txt_vocab_file.good() ||
+            !move_file(vocab_name + ".temp", vocab_name) ||
+            !move_file(txt_vocab_name + ".temp", txt_vocab_name))
+        {
+            std::cout << "Fails to write file: " << vocab_name << std::endl;
+            exit(1);
+        }
+    }
+}
+
+double get_time()
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    auto since_epoch = start.time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::duration<double, std::ratio<1, 1>>>(since_epoch).count();
+}
+
+void print_usage()
+{
+    printf("Usage: reshard_block <input_dir> <num_input_blocks> <output_dir> [options]\n");
+    printf("Options:\n");
+    printf("  -num_blocks <arg>  Min number of output blocks. Default: 1\n");
+    printf("  -block_size <arg>  Max size(MB) of an output block. Default: 1024\n");
+    printf("  -num_threads <arg> Number of threads. Default: 4\n");
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 4 || (argc - 4) % 2 != 0)
+    {
+        print_usage();
+        exit(1);
+    }
+
+    std::string input_dir(argv[1]);
+    int32_t num_input_blocks = atoi(argv[2]);
+    std::string output_dir(argv[3]);
+    int32_t num_blocks = 1;
+    int64_t block_size = 1024;
+    int32_t num_threads = 4;
+    for (int i = 4; i < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-num_blocks") == 0) num_blocks = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-block_size") == 0) block_size = atoll(argv[i + 1]);
+        else if (strcmp(argv[i], "-num_threads") == 0) num_threads = atoi(argv[i + 1]);
+        else
+        {
+            print_usage();
+            exit(1);
+        }
+    }
+    if (num_input_blocks <= 0 || num_blocks <= 0 || block_size <= 0 ||
+        num_threads <= 0)
+    {
+        print_usage();
+        exit(1);
+    }
+    if (input_dir == output_dir)
+    {
+        std::cout << "Output dir should differ from input dir" << std::endl;
+        exit(1);
+    }
+    block_size *= 1024 * 1024;
+
+    double start = get_time();
+
+    // 1. read offsets and vocab of input blocks
+    std::vector<lightlda::block_header> headers(num_input_blocks);
+    std::vector<std::vector<int32_t>> block_global_tf(num_input_blocks);
+    lightlda::parallel_for(num_input_blocks, num_threads, [&](int32_t b)
+    {
+        std::string block_name = input_dir + "/block." + std::to_string(b);
+        std::string vocab_name = input_dir + "/vocab." + std::to_string(b);
+        if (!lightlda::read_header(block_name, headers[b]))
+        {
+            std::cout << "Fails to read file: " << block_name << std::endl;
+            exit(1);
+        }
+        if (!lightlda::read_global_tf(vocab_name, block_global_tf[b]))
+        {
+            std::cout << "Fails to read file: " << vocab_name << std::endl;
+            exit(1);
+        }
+    });
+    std::vector<int32_t> global_tf;
+    int64_t total_doc_num = 0;
+    int64_t total_token_num = 0;
+    int64_t total_byte_size = 0;
+    for (int32_t b = 0; b < num_input_blocks; ++b)
+    {
+        if (block_global_tf[b].size() > global_tf.size())
+        {
+            global_tf.resize(block_global_tf[b].size(), 0);
+        }
+        for (int32_t word = 0; word < block_global_tf[b].size(); ++word)
+        {
+            global_tf[word] = std::max(global_tf[word], block_global_tf[b][word]);
+        }
+        const lightlda::block_header& header = headers[b];
+        total_doc_num += header.doc_num;
+        total_token_num += (header.offsets[header.doc_num] - header.doc_num) / 2;
+        total_byte_size += sizeof(int64_t)* (header.doc_num + 4) +
+            sizeof(int32_t)* header.offsets[header.doc_num];
+        std::cout << "Input block " << b << ": " << header.doc_num << " docs, "
+            << (header.offsets[header.doc_num] - header.doc_num) / 2
+            << " tokens" << std::endl;
+    }
+    block_global_tf.clear();
+    std::cout << "There are totally " << total_doc_num << " docs and "
+        << total_token_num << " tokens" << std::endl;
+
+    // 2. plan output blocks, enough of them for all to be under block_size
+    if (total_doc_num == 0)
+    {
+        std::cout << "There is no document to reshard" << std::endl;
+        exit(1);
+    }
+    for (int32_t b = 0; b < num_input_blocks; ++b)
+    {
+        const std::vector<int64_t>& offsets = headers[b].offsets;
+        for (int64_t d = 0; d < headers[b].doc_num; ++d)
+        {
+            int64_t byte_size = sizeof(lightlda::block_file_header) +
+                sizeof(int64_t)* 2 + sizeof(int32_t)* (offsets[d + 1] - offsets[d]);
+            if (byte_size > block_size)
+            {
+                std::cout << "Doc " << d << " of input block " << b << " needs "
+                    << byte_size / 1024.0 / 1024.0 << " MB, more than block_size"
+                    << std::endl;
+                exit(1);
+            }
+        }
+    }
+    num_blocks = static_cast<int32_t>(std::min(total_doc_num,
+        std::max<int64_t>(num_blocks, (total_byte_size + block_size - 1) / block_size)));
+    std::vector<lightlda::output_plan> plans = lightlda::plan_blocks(
+        headers, total_doc_num, total_token_num, num_blocks, block_size);
+    num_blocks = static_cast<int32_t>(plans.size());
+
+    // 3. write output blocks
+    double write_start = get_time();
+    lightlda::parallel_for(num_blocks, num_threads, [&](int32_t k)
+    {
+        lightlda::write_block(input_dir, headers, plans[k], global_tf,
+            output_dir, k);
+    });
+    double write_end = get_time();
+
+    for (int32_t k = 0; k < num_blocks; ++k)
+    {
+        std::cout << "Output block " << k << ": " << plans[k].doc_num << " docs, "
+            << plans[k].token_num << " tokens, "
+            << lightlda::block_byte_size(plans[k]) / 1024.0 / 1024.0 << " MB" << std::endl;
+    }
+    std::cout << "Elapsed seconds for reshard blocks: " << (write_end - start)
+        << ", " << total_byte_size / 1024.0 / 1024.0 / (write_end - write_start)
+        << " MB/s" << std::endl;
+    return 0;
+}
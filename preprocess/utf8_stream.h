@@ -0,0 +1,343 @@
+/*!
+ * \file utf8_stream.h
+ * \brief Buffered line reader of text input, shared by the preprocessing tools
+ */
+
+#ifndef LIGHTLDA_UTF8_STREAM_H_
+#define LIGHTLDA_UTF8_STREAM_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "libsvm_tokenizer.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#define popen _popen
+#define pclose _pclose
+#endif
+
+namespace lightlda
+{
+    /*
+    command decompressing a .gz or .zst file to the standard output, or an
+    empty string for other files. The decompressor runs as another process,
+    so it decodes the next data while the reader parses the previous data.
+    */
+    inline std::string decompress_command(const std::string& file_name)
+    {
+        auto ends_with = [&file_name](const std::string& suffix)
+        {
+            return file_name.size() >= suffix.size() &&
+                file_name.compare(file_name.size() - suffix.size(), suffix.size(), suffix) == 0;
+        };
+        std::string program;
+        if (ends_with(".gz")) program = "gzip";
+        else if (ends_with(".zst")) program = "zstd";
+        else return "";
+#ifdef _WIN32
+        return program + " -dc \"" + file_name + "\"";
+#else
+        std::string quoted;
+        for (char c : file_name)
+        {
+            if (c == '\'') quoted += "'\\''";
+            else quoted += c;
+        }
+        return program + " -dc '" + quoted + "'";
+#endif
+    }
+
+    /*
+    whether the input can only be read from the beginning, as the standard
+    input "-" and compressed files
+    */
+    inline bool is_stream_input(const std::string& file_name)
+    {
+        return file_name == "-" || !decompress_command(file_name).empty();
+    }
+
+    /*
+    (1) open an utf-8 encoded file in binary mode,
+    get its content line by line. Working around the CTRL-Z issue in Windows text file reading.
+    (2) assuming each line ends with '\n'
+    */
+    class utf8_stream
+    {
+    public:
+        explicit utf8_stream(int32_t block_buf_size = 1024 * 1024 * 800);
+        ~utf8_stream();
+
+        bool open(const std::string& file_name);
+        /*
+        open the byte range [begin, end) of a file, end = -1 means the end of file.
+        file name "-" means the standard input, which can only be read from begin = 0,
+        as well as .gz and .zst files, which are read through a decompressor.
+        */
+        bool open(const std::string& file_name, int64_t begin, int64_t end);
+
+        /*
+        return true if successfully get a line (may be empty), false if not.
+        It is user's task to verify whether a line is empty or not.
+        */
+        bool getline(std::string &line);
+        /*
+        get a line without copy, [line_begin, line_end) is valid until the next call.
+        a line should not be longer than the buffer.
+        */
+        bool getline(const char*& line_begin, const char*& line_end);
+        // number of bytes read from the file, after decompression
+        int64_t bytes_read() const { return bytes_read_; }
+        // false if the decompressor failed
+        bool close();
+    private:
+        bool block_is_empty();
+        bool fill_block();
+        // read at most block_buf_size_ bytes, not beyond the range end
+        int64_t read_block(char* buffer, int64_t capacity);
+        // file_stream_, or std::cin for file name "-"
+        std::istream* stream_;
+        std::ifstream file_stream_;
+        // output of the decompressor, stream_ is not used if not nullptr
+        FILE* pipe_;
+        std::string file_name_;
+        const int32_t block_buf_size_;
+        std::string block_buf_;
+        int64_t range_left_;
+        int64_t bytes_read_;
+        std::string::size_type buf_idx_;
+        std::string::size_type buf_end_;
+
+        utf8_stream(const utf8_stream& other) = delete;
+        utf8_stream& operator=(const utf8_stream& other) = delete;
+    };
+
+    inline utf8_stream::utf8_stream(int32_t block_buf_size)
+        : stream_(nullptr), pipe_(nullptr), block_buf_size_(block_buf_size)
+    {
+        block_buf_.resize(block_buf_size_);
+    }
+    inline utf8_stream::~utf8_stream()
+    {
+        close();
+    }
+
+    inline bool utf8_stream::open(const std::string& file_name)
+    {
+        return open(file_name, 0, -1);
+    }
+
+    inline bool utf8_stream::open(const std::string& file_name, int64_t begin, int64_t end)
+    {
+        file_name_ = file_name;
+        buf_idx_ = 0;
+        buf_end_ = 0;
+        range_left_ = end < 0 ? -1 : end - begin;
+        bytes_read_ = 0;
+        if (file_name == "-")
+        {
+#ifdef _WIN32
+            _setmode(_fileno(stdin), _O_BINARY);
+#endif
+            std::ios::sync_with_stdio(false);
+            stream_ = &std::cin;
+            return begin == 0;
+        }
+        std::string command = decompress_command(file_name);
+        if (!command.empty())
+        {
+            if (begin != 0 || !std::ifstream(file_name).good())
+            {
+                return false;
+            }
+#ifdef _WIN32
+            pipe_ = popen(command.c_str(), "rb");
+#else
+            pipe_ = popen(command.c_str(), "r");
+#endif
+            return pipe_ != nullptr;
+        }
+        file_stream_.open(file_name, std::ios::in | std::ios::binary);
+        file_stream_.seekg(begin);
+        stream_ = &file_stream_;
+        return file_stream_.good();
+    }
+
+    inline int64_t utf8_stream::read_block(char* buffer, int64_t capacity)
+    {
+        int64_t size = capacity;
+        if (range_left_ >= 0)
+        {
+            size = std::min(size, range_left_);
+        }
+        if (size == 0)
+        {
+            return 0;
+        }
+        int64_t count;
+        if (pipe_ != nullptr)
+        {
+            count = fread(buffer, 1, size, pipe_);
+        }
+        else
+        {
+            stream_->read(buffer, size);
+            count = stream_->gcount();
+        }
+        bytes_read_ += count;
+        if (range_left_ >= 0)
+        {
+            range_left_ -= count;
+        }
+        return count;
+    }
+
+    inline bool utf8_stream::getline(std::string& line)
+    {
+        line = "";
+        while (true)
+        {
+            if (block_is_empty())
+            {
+                // if the block_buf_ is empty, fill the block_buf_
+                if (!fill_block())
+                {
+                    // if fail to fill the block_buf_, that means we reach the end of file
+                    if (!line.empty())
+                        std::cout << "Invalid format, according to our assumption: "
+                       "each line has an \\n. However, we reach here with an non-empty line but not find an \\n";
+                    return false;
+                }
+            }
+            // the block is not empty now
+
+            // only search the filled part, the rest holds an older block
+            const char* begin = block_buf_.data() + buf_idx_;
+            const char* end = find_char(begin, block_buf_.data() + buf_end_, '\n');
+            if (end != nullptr)
+            {
+                // successfully find a new line
+                line.append(begin, end - begin);
+                buf_idx_ += end - begin + 1;
+                return true;
+            }
+            else
+            {
+                // do not find an \n untile the end of block_buf_
+                line.append(block_buf_, buf_idx_, buf_end_ - buf_idx_);
+                buf_idx_ = buf_end_;
+            }
+        }
+        return false;
+    }
+
+    inline bool utf8_stream::getline(const char*& line_begin, const char*& line_end)
+    {
+        while (true)
+        {
+            const char* begin = block_buf_.data() + buf_idx_;
+            const char* end = find_char(begin, block_buf_.data() + buf_end_, '\n');
+            if (end != nullptr)
+            {
+                line_begin = begin;
+                line_end = end;
+                buf_idx_ += end - begin + 1;
+                return true;
+            }
+            // move the partial line to the front, then fill the rest
+            std::string::size_type left = buf_end_ - buf_idx_;
+            if (left == block_buf_size_)
+            {
+                std::cout << "Line longer than the buffer size " << block_buf_size_ << std::endl;
+                return false;
+            }
+            memmove(&block_buf_[0], begin, left);
+            buf_idx_ = 0;
+            buf_end_ = left;
+            int64_t count = read_block(&block_buf_[0] + left, block_buf_size_ - left);
+            if (count == 0)
+            {
+                if (left != 0)
+                    std::cout << "Invalid format, according to our assumption: "
+                   "each line has an \\n. However, we reach here with an non-empty line but not find an \\n";
+                return false;
+            }
+            buf_end_ += count;
+        }
+    }
+
+    inline bool utf8_stream::block_is_empty()
+    {
+        return buf_idx_ == buf_end_;
+    }
+
+    inline bool utf8_stream::fill_block()
+    {
+        char* buffer = &block_buf_[0];
+        buf_idx_ = 0;
+        buf_end_ = static_cast<std::string::size_type>(read_block(buffer, block_buf_size_));
+        return buf_end_ != 0;
+    }
+
+    inline bool utf8_stream::close()
+    {
+        if (file_stream_.is_open())
+        {
+            file_stream_.close();
+        }
+        if (pipe_ != nullptr)
+        {
+            int status = pclose(pipe_);
+            pipe_ = nullptr;
+            return status == 0;
+        }
+        return true;
+    }
+
+    /*
+     * split the input file into num_ranges byte ranges, each range ends after
+     * a '\n' so that no line is cut. Returns the num_ranges + 1 boundaries.
+     * The standard input "-" and compressed files are not split, their range
+     * is [0, -1).
+     */
+    inline std::vector<int64_t> split_file(const std::string& file_name, int32_t num_ranges)
+    {
+        if (is_stream_input(file_name))
+        {
+            return { 0, -1 };
+        }
+        std::ifstream stream(file_name, std::ios::in | std::ios::binary | std::ios::ate);
+        if (!stream.good())
+        {
+            std::cout << "Fails to open file: " << file_name << std::endl;
+            exit(1);
+        }
+        int64_t file_size = stream.tellg();
+        std::vector<int64_t> bounds(num_ranges + 1, file_size);
+        bounds[0] = 0;
+        for (int32_t i = 1; i < num_ranges; ++i)
+        {
+            int64_t pos = std::max(bounds[i - 1], file_size * i / num_ranges);
+            if (pos > 0 && pos < file_size)
+            {
+                // move to the char after the next '\n', searching from pos - 1
+                stream.clear();
+                stream.seekg(pos - 1);
+                int c;
+                while ((c = stream.get()) != EOF && c != '\n') ++pos;
+                pos = (c == EOF) ? file_size : pos;
+            }
+            bounds[i] = pos;
+        }
+        return bounds;
+    }
+}
+
+#endif // LIGHTLDA_UTF8_STREAM_H_
@@ -0,0 +1,93 @@
+/*!
+ * \file word_map.h
+ * \brief Word map file between the word ids of the input and the word
+ *  ids renumbered by descending term frequency, shared by remap_vocab
+ *  and dump_binary. The file has a "new_id TAB old_id" line for each
+ *  word, in the order of new ids, which start from 0.
+ */
+
+#ifndef LIGHTLDA_WORD_MAP_H_
+#define LIGHTLDA_WORD_MAP_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "libsvm_tokenizer.h"
+#include "utf8_stream.h"
+
+namespace lightlda
+{
+    /*!
+     * \brief reads the word map file into new_to_old, indexed by new id
+     * \return false if the file can not be opened or is invalid, which
+     *  includes an old id mapped from two new ids
+     */
+    inline bool read_word_map(const std::string& file_name,
+        std::vector<int32_t>& new_to_old)
+    {
+        utf8_stream stream(1024 * 1024 * 16);
+        if (!stream.open(file_name))
+        {
+            return false;
+        }
+        new_to_old.clear();
+        std::vector<bool> seen;
+        const char* line_begin = nullptr;
+        const char* line_end = nullptr;
+        while (stream.getline(line_begin, line_end))
+        {
+            int32_t new_id, old_id;
+            if (!parse_uint(line_begin, line_end, new_id) ||
+                line_begin == line_end || *line_begin != '\t')
+            {
+                return false;
+            }
+            ++line_begin;
+            if (!parse_uint(line_begin, line_end, old_id) ||
+                new_id != new_to_old.size())
+            {
+                return false;
+            }
+            if (old_id >= seen.size())
+            {
+                seen.resize(old_id + 1, false);
+            }
+            if (seen[old_id])
+            {
+                return false;
+            }
+            seen[old_id] = true;
+            new_to_old.push_back(old_id);
+        }
+        stream.close();
+        return true;
+    }
+
+    /*!
+     * \brief maps old ids to new ids, -1 for old ids not in the map
+     * \return false if an old id is mapped from two new ids
+     */
+    inline bool invert_word_map(const std::vector<int32_t>& new_to_old,
+        std::vector<int32_t>& old_to_new)
+    {
+        int32_t old_num = 0;
+        for (auto old_id : new_to_old)
+        {
+            old_num = std::max(old_num, old_id + 1);
+        }
+        old_to_new.assign(old_num, -1);
+        for (int32_t new_id = 0; new_id < new_to_old.size(); ++new_id)
+        {
+            if (old_to_new[new_to_old[new_id]] != -1)
+            {
+                return false;
+            }
+            old_to_new[new_to_old[new_id]] = new_id;
+        }
+        return true;
+    }
+}
+
+#endif // LIGHTLDA_WORD_MAP_H_
@@ -5,10 +5,14 @@
 #include "util.h"
 #include "meta.h"
 
+#include <algorithm>
+
 #include <multiverso/lock.h>
 #include <multiverso/log.h>
+#include <multiverso/multiverso.h>
 #include <multiverso/row.h>
 #include <multiverso/row_iter.h>
+#include <multiverso/stop_watch.h>
 
 namespace multiverso { namespace lightlda
 {
@@ -100,7 +104,98 @@ namespace multiverso { namespace lightlda
         return (idx & m) | (k & ~m);
     }
 
+    void AliasTable::Plan(const int32_t* begin, const int32_t* end,
+        ModelBase* model)
+    {
+        PlanRows(begin, end, model);
+    }
+
+    void AliasTable::Plan(const int32_t* begin, const int32_t* end,
+        CompactModel* model)
+    {
+        PlanRows(begin, end, model);
+    }
+
+    int64_t AliasTable::Capacity(const Meta* meta, const CompactModel* model)
+    {
+        int64_t capacity = 0;
+        for (int32_t block = 0; block < Config::num_blocks; ++block)
+        {
+            const LocalVocab& vocab = meta->local_vocab(block);
+            int64_t size = 0;
+            for (int32_t slice = 0; slice < vocab.num_slice(); ++slice)
+            {
+                for (const int32_t* p = vocab.begin(slice); 
+                    p != vocab.end(slice); ++p)
+                {
+                    size += RowSize(model->GetWordTopicRow(*p).NonzeroSize());
+                }
+            }
+            capacity = std::max(capacity, size);
+        }
+        capacity *= sizeof(int32_t);
+        Log::Info("Actual Alias capacity: %lld MB\n", capacity / 1024 / 1024);
+        return capacity;
+    }
+
+    int64_t AliasTable::RowSize(int32_t size)
+    {
+        // a dense row takes 2 int32 per topic, a sparse row 3 int32 per
+        // nonzero topic, the smaller one is used
+        return std::min(2 * static_cast<int64_t>(Config::num_topics), 
+            3 * static_cast<int64_t>(size));
+    }
+
+    template <typename Model>
+    void AliasTable::PlanRows(const int32_t* begin, const int32_t* end,
+        Model* model)
+    {
+        StopWatch watch; watch.Start();
+        int64_t offset = 0;
+        int64_t last_offset = 0;
+        int32_t num_dense = 0;
+        int32_t num_converted = 0;
+        for (const int32_t* p = begin; p != end; ++p)
+        {
+            WordEntry& word_entry = table_index_->word_entry(*p);
+            last_offset += word_entry.is_dense ? 
+                2 * num_topics_ : 3 * word_entry.capacity;
+            int32_t size = model->GetWordTopicRow(*p).NonzeroSize();
+            bool is_dense = 3 * static_cast<int64_t>(size) > 2 * num_topics_;
+            if (is_dense != word_entry.is_dense) ++num_converted;
+            if (is_dense) ++num_dense;
+            word_entry.is_dense = is_dense;
+            word_entry.capacity = is_dense ? num_topics_ : size;
+            word_entry.begin_offset = offset;
+            offset += RowSize(size);
+        }
+        if (offset > memory_size_)
+        {
+            Log::Fatal("Alias rows of %lld MB exceed the alias capacity of "
+                "%lld MB\n", offset * sizeof(int32_t) / 1024 / 1024, 
+                memory_size_ * sizeof(int32_t) / 1024 / 1024);
+        }
+        Log::Info("Rank = %d, alias rows: %d dense, %d sparse, %d converted, "
+            "%.2f MB from %.2f MB, plan time used: %.2f s\n",
+            Multiverso::ProcessRank(), num_dense, 
+            static_cast<int32_t>(end - begin) - num_dense, num_converted,
+            offset * sizeof(int32_t) / 1024.0 / 1024.0,
+            last_offset * sizeof(int32_t) / 1024.0 / 1024.0, 
+            watch.ElapsedSeconds());
+    }
+
     int32_t AliasTable::Build(int32_t word, ModelBase* model)
+    {
+        return BuildRow(word, model);
+    }
+
+    int32_t AliasTable::Build(int32_t word, CompactModel* model)
+    {
+        return BuildRow(word, model);
+    }
+
+    template <typename Model>
+    int32_t AliasTable::BuildRow(int32_t word, Model* model)
     {       
         // memory for build alias table, both for alpha alias and word-topic alias
         if (q_w_proportion_ == nullptr)
@@ -112,7 +207,8 @@ namespace multiverso { namespace lightlda
         if (H_ == nullptr)
             H_ = new std::vector<std::pair<int32_t, int32_t>>(num_topics_);
         // Compute the proportion
-        Row<int64_t>& summary_row = model->GetSummaryRow();
+        // a Row of ModelBase, or a view of CompactModel
+        auto&& summary_row = model->GetSummaryRow();
         if (word == -1) // build alias row for beta 
         {
             beta_mass_ = 0;
@@ -127,7 +223,7 @@ namespace multiverso { namespace lightlda
         else // build alias row for word
         {            
             WordEntry& word_entry = table_index_->word_entry(word);
-            Row<int32_t>& word_topic_row = model->GetWordTopicRow(word);
+            auto&& word_topic_row = model->GetWordTopicRow(word);
             int32_t size = 0;
             mass_[word] = 0;
             if (word_entry.is_dense)
@@ -145,7 +241,7 @@ namespace multiverso { namespace lightlda
                 word_entry.capacity = word_topic_row.NonzeroSize();
                 int32_t* idx_vector = memory_block_ + word_entry.begin_offset 
                     + 2 * word_entry.capacity;
-                Row<int32_t>::iterator iter = word_topic_row.Iterator();
+                auto iter = word_topic_row.Iterator();
                 while (iter.HasNext())
                 {
                     int32_t t = iter.Key();
@@ -21,6 +21,8 @@
 
 namespace multiverso { namespace lightlda
 {
+    class CompactModel;
+    class Meta;
     class ModelBase;
     class xorshift_rng;
     class AliasTableIndex;
@@ -41,6 +43,21 @@ namespace multiverso { namespace lightlda
          * \brief Set the table index. Must call this method before 
          */
         void Init(AliasTableIndex* table_index);
+        /*!
+         * \brief Lays out the alias rows of words [begin, end) in the table
+         *  index by the nonzero topics of their rows in the model, a row is
+         *  dense if that takes less memory than a sparse one. Must call 
+         *  after Init and before Build
+         */
+        void Plan(const int32_t* begin, const int32_t* end, ModelBase* model);
+        /*! \brief Lays out the alias rows from the model of inference */
+        void Plan(const int32_t* begin, const int32_t* end, CompactModel* model);
+        /*!
+         * \brief Gets the alias capacity in bytes Plan needs for the block
+         *  of meta with most alias memory, the tf of the data to infer does
+         *  not bound the rows of the model
+         */
+        static int64_t Capacity(const Meta* meta, const CompactModel* model);
         /*!
          * \brief Build alias table for a word
          * \param word word to bulid
@@ -48,6 +65,8 @@ namespace multiverso { namespace lightlda
          * \return success of not
          */
         int Build(int word, ModelBase* model);
+        /*! \brief Build alias table for a word from the model of inference */
+        int Build(int word, CompactModel* model);
         /*!
          * \brief sample from word proposal distribution
          * \param word word to sample
@@ -79,6 +98,14 @@ namespace multiverso { namespace lightlda
         /*! \brief Clear the alias table */
         void Clear();
     private:
+        /*! \brief Number of int32 of the alias row of size nonzero topics */
+        static int64_t RowSize(int32_t size);
+        /*! \brief Implements Plan for ModelBase and CompactModel */
+        template <typename Model>
+        void PlanRows(const int32_t* begin, const int32_t* end, Model* model);
+        /*! \brief Implements Build for ModelBase and CompactModel */
+        template <typename Model>
+        int BuildRow(int word, Model* model);
         void AliasMultinomialRNG(int32_t size, float mass, int32_t& height,
             int32_t* kv_vector);
         int* memory_block_;
@@ -0,0 +1,301 @@
+#include "checkpoint.h"
+
+#include "common.h"
+#include "data_block.h"
+#include "document.h"
+#include "util.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include <multiverso/log.h>
+#include <multiverso/multiverso.h>
+#include <multiverso/stop_watch.h>
+
+namespace multiverso { namespace lightlda
+{
+    Checkpoint::Checkpoint(const std::string& path)
+        : path_(path), committed_slot_(-1), slot_(0), iteration_(0),
+        busy_(false), stop_(false)
+    {
+        slot_iterations_[0] = slot_iterations_[1] = -1;
+        if (!MakeDirectory(path_) || !MakeDirectory(SlotPath(0)) ||
+            !MakeDirectory(SlotPath(1)))
+        {
+            Log::Fatal("Failed to create checkpoint dir %s\n", path_.c_str());
+        }
+        snapshot_ = new DataBlock();
+        Load();
+        writer_thread_ = std::thread(&Checkpoint::WriterMain, this);
+    }
+
+    Checkpoint::~Checkpoint()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        writer_thread_.join();
+        delete snapshot_;
+    }
+
+    void Checkpoint::Begin(int32_t iteration)
+    {
+        Wait();
+        slot_ = (committed_slot_ == 0) ? 1 : 0;
+        iteration_ = iteration;
+        if (slot_iterations_[slot_] >= 0)
+        {
+            // the slot is overwritten, it is not usable until committed
+            slot_iterations_[slot_] = -1;
+            WriteManifest(committed_slot_);
+        }
+        Log::Info("Rank = %d, begin checkpoint of iteration %d to %s\n",
+            Multiverso::ProcessRank(), iteration, SlotPath(slot_).c_str());
+    }
+
+    void Checkpoint::AddBlock(int32_t block, const DataBlock& data)
+    {
+        // Only one block is held, wait for the previous block to be written
+        Wait();
+        snapshot_->CopyFrom(data);
+        std::string prefix = SlotPath(slot_) + "/";
+        Submit([this, block, prefix]()
+        {
+            StopWatch watch; watch.Start();
+            snapshot_->WriteTo(prefix + "block." + std::to_string(block));
+            WriteCounts(prefix + "word_topic." + std::to_string(block));
+            Log::Info("Rank = %d, checkpoint block %d, time used: %.2f s\n",
+                Multiverso::ProcessRank(), block, watch.ElapsedSeconds());
+        });
+    }
+
+    void Checkpoint::Commit(const std::vector<uint32_t>& rng_states)
+    {
+        int32_t slot = slot_;
+        int32_t iteration = iteration_;
+        Submit([this, slot, iteration, rng_states]()
+        {
+            slot_iterations_[slot] = iteration;
+            slot_rng_states_[slot] = rng_states;
+            WriteManifest(slot);
+            committed_slot_ = slot;
+            Log::Info("Rank = %d, checkpoint of iteration %d committed\n",
+                Multiverso::ProcessRank(), iteration);
+        });
+    }
+
+    bool Checkpoint::Load()
+    {
+        std::ifstream manifest(path_ + "/manifest");
+        if (!manifest.good())
+        {
+            return false;
+        }
+        std::string key;
+        int32_t num_blocks = -1;
+        committed_slot_ = -1;
+        int32_t slot = 0;
+        int32_t num_states = 0;
+        while (manifest >> key)
+        {
+            if (key == "committed") manifest >> committed_slot_;
+            else if (key == "num_blocks") manifest >> num_blocks;
+            else if (key == "slot" && manifest >> slot && 
+                slot >= 0 && slot <= 1)
+            {
+                // slot <slot> <iteration> <num states> <rng states>
+                manifest >> slot_iterations_[slot] >> num_states;
+                slot_rng_states_[slot].resize(num_states);
+                for (auto& state : slot_rng_states_[slot]) manifest >> state;
+            }
+        }
+        if (committed_slot_ < 0 || committed_slot_ > 1 ||
+            slot_iterations_[committed_slot_] < 0 ||
+            num_blocks != Config::num_blocks)
+        {
+            Log::Error("Invalid checkpoint manifest in %s\n", path_.c_str());
+            committed_slot_ = -1;
+            slot_iterations_[0] = slot_iterations_[1] = -1;
+            return false;
+        }
+        Log::Info("Rank = %d, checkpoints of iteration %d and %d in %s\n",
+            Multiverso::ProcessRank(), slot_iterations_[committed_slot_],
+            slot_iterations_[1 - committed_slot_], path_.c_str());
+        return true;
+    }
+
+    bool Checkpoint::Select(int32_t iteration)
+    {
+        if (committed_slot_ < 0)
+        {
+            return false;
+        }
+        if (iteration < 0 || slot_iterations_[committed_slot_] == iteration)
+        {
+            return true;
+        }
+        if (slot_iterations_[1 - committed_slot_] == iteration)
+        {
+            // the next checkpoint replaces the later one, which the other
+            // processes do not have
+            committed_slot_ = 1 - committed_slot_;
+            return true;
+        }
+        return false;
+    }
+
+    void Checkpoint::RestoreBlock(int32_t block,
+        const std::string& file_name) const
+    {
+        std::string block_file = SlotPath(committed_slot_) + "/block."
+            + std::to_string(block);
+        snapshot_->Read(block_file);
+        snapshot_->WriteTo(file_name);
+    }
+
+    void Checkpoint::RestoreTables(int32_t block) const
+    {
+        std::string file_name = SlotPath(committed_slot_) + "/word_topic."
+            + std::to_string(block);
+        std::ifstream count_file(file_name, std::ios::in | std::ios::binary);
+        if (!count_file.good())
+        {
+            Log::Fatal("Failed to open file %s\n", file_name.c_str());
+        }
+        int64_t num_entries = 0;
+        count_file.read(reinterpret_cast<char*>(&num_entries), sizeof(int64_t));
+        std::vector<int32_t> entries(num_entries * 3);
+        count_file.read(reinterpret_cast<char*>(entries.data()),
+            sizeof(int32_t)* entries.size());
+        count_file.close();
+
+        std::vector<int64_t> summary(Config::num_topics, 0);
+        for (int64_t i = 0; i < num_entries; ++i)
+        {
+            int32_t word = entries[3 * i];
+            int32_t topic = entries[3 * i + 1];
+            int32_t count = entries[3 * i + 2];
+            Multiverso::AddToServer<int32_t>(kWordTopicTable,
+                word, topic, count);
+            summary[topic] += count;
+        }
+        for (int32_t topic = 0; topic < Config::num_topics; ++topic)
+        {
+            if (summary[topic] != 0)
+            {
+                Multiverso::AddToServer<int64_t>(kSummaryRow,
+                    0, topic, summary[topic]);
+            }
+        }
+    }
+
+    void Checkpoint::WriterMain()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+                if (tasks_.empty())
+                {
+                    break;
+                }
+                task = tasks_.front();
+                tasks_.pop();
+                busy_ = true;
+            }
+            task();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                busy_ = false;
+            }
+            cv_.notify_all();
+        }
+    }
+
+    void Checkpoint::Submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push(task);
+        }
+        cv_.notify_all();
+    }
+
+    void Checkpoint::Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return tasks_.empty() && !busy_; });
+    }
+
+    void Checkpoint::WriteCounts(const std::string& file_name)
+    {
+        // Aggregates (word, topic) of all tokens by sorting the packed keys
+        std::vector<int64_t> keys;
+        for (int32_t i = 0; i < snapshot_->Size(); ++i)
+        {
+            Document doc = snapshot_->GetOneDoc(i);
+            for (int32_t j = 0; j < doc.Size(); ++j)
+            {
+                keys.push_back((static_cast<int64_t>(doc.Word(j)) << 32)
+                    | doc.Topic(j));
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+        std::vector<int32_t> entries;
+        for (size_t i = 0; i < keys.size();)
+        {
+            size_t j = i;
+            while (j < keys.size() && keys[j] == keys[i]) ++j;
+            entries.push_back(static_cast<int32_t>(keys[i] >> 32));
+            entries.push_back(static_cast<int32_t>(keys[i] & 0xffffffff));
+            entries.push_back(static_cast<int32_t>(j - i));
+            i = j;
+        }
+
+        std::string temp_file = file_name + ".temp";
+        std::ofstream count_file(temp_file, std::ios::out | std::ios::binary);
+        if (!count_file.good())
+        {
+            Log::Fatal("Failed to open file %s\n", temp_file.c_str());
+        }
+        int64_t num_entries = entries.size() / 3;
+        count_file.write(reinterpret_cast<char*>(&num_entries), sizeof(int64_t));
+        count_file.write(reinterpret_cast<char*>(entries.data()),
+            sizeof(int32_t)* entries.size());
+        count_file.close();
+        AtomicMoveFile(temp_file, file_name);
+    }
+
+    void Checkpoint::WriteManifest(int32_t slot)
+    {
+        std::string file_name = path_ + "/manifest";
+        std::string temp_file = file_name + ".temp";
+        std::ofstream manifest(temp_file);
+        if (!manifest.good())
+        {
+            Log::Fatal("Failed to open file %s\n", temp_file.c_str());
+        }
+        manifest << "committed " << slot << "\n";
+        manifest << "num_blocks " << Config::num_blocks << "\n";
+        for (int32_t i = 0; i < 2; ++i)
+        {
+            if (slot_iterations_[i] < 0) continue;
+            manifest << "slot " << i << " " << slot_iterations_[i] << " "
+                << slot_rng_states_[i].size();
+            for (auto state : slot_rng_states_[i]) manifest << " " << state;
+            manifest << "\n";
+        }
+        manifest.close();
+        AtomicMoveFile(temp_file, file_name);
+    }
+
+    std::string Checkpoint::SlotPath(int32_t slot) const
+    {
+        return path_ + "/slot." + std::to_string(slot);
+    }
+} // namespace lightlda
+} // namespace multiverso
@@ -0,0 +1,125 @@
+/*!
+ * \file checkpoint.h
+ * \brief Defines checkpoint and resume of the training state
+ */
+
+#ifndef LIGHTLDA_CHECKPOINT_H_
+#define LIGHTLDA_CHECKPOINT_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace multiverso { namespace lightlda
+{
+    class DataBlock;
+
+    /*!
+     * \brief Checkpoint saves the training state of this process: topic
+     *  assignments of all blocks, the word-topic counts these assignments
+     *  contribute to the parameter tables, the iteration and the rng
+     *  states of trainers. Blocks are copied when added and written by a
+     *  background thread, so training goes on during the checkpoint.
+     *
+     *  Files are written to one of two slots under the checkpoint
+     *  directory, in turn. The manifest recording the iteration of both
+     *  slots is replaced last, so a crash during a checkpoint leaves the
+     *  previous one usable. Processes checkpoint independently, a process
+     *  may miss the last checkpoint of the others, so the previous one is
+     *  kept for all processes to resume from the same iteration.
+     */
+    class Checkpoint
+    {
+    public:
+        explicit Checkpoint(const std::string& path);
+        ~Checkpoint();
+        /*!
+         * \brief Starts a checkpoint
+         * \param iteration the next iteration to train after resume
+         */
+        void Begin(int32_t iteration);
+        /*!
+         * \brief Adds a block to the current checkpoint. The block can be
+         *  modified as soon as this method returns
+         */
+        void AddBlock(int32_t block, const DataBlock& data);
+        /*! \brief Commits the current checkpoint when all blocks are added */
+        void Commit(const std::vector<uint32_t>& rng_states);
+
+        /*! \brief Whether a committed checkpoint was found in the directory */
+        bool HasCommitted() const;
+        /*!
+         * \brief Selects the checkpoint to restore
+         * \param iteration iteration of the checkpoint, the last one if < 0
+         * \return false if neither slot holds the iteration
+         */
+        bool Select(int32_t iteration);
+        /*! \brief Copies a block of the loaded checkpoint to file_name */
+        void RestoreBlock(int32_t block, const std::string& file_name) const;
+        /*! \brief Adds the word-topic counts of a block to server tables */
+        void RestoreTables(int32_t block) const;
+
+        int32_t iteration() const;
+        const std::vector<uint32_t>& rng_states() const;
+    private:
+        /*! \brief Loads the last committed checkpoint, false if not found */
+        bool Load();
+        /*! \brief Background thread entrance function */
+        void WriterMain();
+        /*! \brief Pushes a task to the background thread */
+        void Submit(std::function<void()> task);
+        /*! \brief Waits until the background thread is idle */
+        void Wait();
+        /*! \brief Writes the word-topic counts of snapshot_ to file */
+        void WriteCounts(const std::string& file_name);
+        /*! \brief Writes the manifest of both slots, slot committed last */
+        void WriteManifest(int32_t slot);
+        std::string SlotPath(int32_t slot) const;
+
+        /*! \brief path of checkpoint directory */
+        std::string path_;
+        /*! \brief slot of the last committed or selected checkpoint, -1 if none */
+        int32_t committed_slot_;
+        /*! \brief slot of the checkpoint in progress */
+        int32_t slot_;
+        /*! \brief iteration of the checkpoint in progress */
+        int32_t iteration_;
+        /*! \brief iteration of the checkpoint of each slot, -1 if none */
+        int32_t slot_iterations_[2];
+        std::vector<uint32_t> slot_rng_states_[2];
+        /*! \brief copy of the block being written */
+        DataBlock* snapshot_;
+
+        std::queue<std::function<void()>> tasks_;
+        bool busy_;
+        bool stop_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::thread writer_thread_;
+
+        // No copying allowed
+        Checkpoint(const Checkpoint&);
+        void operator=(const Checkpoint&);
+    };
+
+    // -- inline functions definition area --------------------------------- //
+    inline bool Checkpoint::HasCommitted() const { return committed_slot_ >= 0; }
+    inline int32_t Checkpoint::iteration() const
+    {
+        return slot_iterations_[committed_slot_];
+    }
+    inline const std::vector<uint32_t>& Checkpoint::rng_states() const
+    {
+        return slot_rng_states_[committed_slot_];
+    }
+    // -- inline functions definition area --------------------------------- //
+
+} // namespace lightlda
+} // namespace multiverso
+
+#endif // LIGHTLDA_CHECKPOINT_H_
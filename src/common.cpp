@@ -15,6 +15,7 @@ namespace multiverso { namespace lightlda
     int32_t Config::num_local_workers = 1;
     int32_t Config::num_aggregator = 1;
     int32_t Config::num_blocks = 1;
+    int32_t Config::num_io_threads = 4;
     int64_t Config::max_num_document = -1;
     float Config::alpha = 0.01f;
     // XXX(lisendong) negative value means not use asymmetric alpha, just use uniform alpha value
@@ -23,6 +24,13 @@ namespace multiverso { namespace lightlda
     std::string Config::server_file = "";
     std::string Config::input_dir = "";
     bool Config::warm_start = false;
+    bool Config::resume = false;
+    int32_t Config::resume_iteration = -1;
+    int32_t Config::checkpoint_interval = 0;
+    std::string Config::checkpoint_dir = "";
+    int32_t Config::export_interval = 0;
+    std::string Config::export_dir = "";
+    bool Config::export_text = false;
     bool Config::inference = false;
     bool Config::out_of_core = false;
     bool Config::word_init = false;
@@ -52,6 +60,7 @@ namespace multiverso { namespace lightlda
             if (strcmp(argv[i], "-num_local_workers") == 0) num_local_workers = atoi(argv[i + 1]);
             if (strcmp(argv[i], "-num_aggregator") == 0) num_aggregator = atoi(argv[i + 1]);
             if (strcmp(argv[i], "-num_blocks") == 0) num_blocks = atoi(argv[i + 1]);
+            if (strcmp(argv[i], "-num_io_threads") == 0) num_io_threads = atoi(argv[i + 1]);
             if (strcmp(argv[i], "-max_num_document") == 0) max_num_document = atoll(argv[i + 1]);
             if (strcmp(argv[i], "-alpha") == 0) alpha = static_cast<float>(atof(argv[i + 1]));
             if (strcmp(argv[i], "-asymmetric_alpha") == 0) asymmetric_alpha = static_cast<float>(atof(argv[i + 1]));
@@ -59,6 +68,13 @@ namespace multiverso { namespace lightlda
             if (strcmp(argv[i], "-input_dir") == 0) input_dir = std::string(argv[i + 1]);
             if (strcmp(argv[i], "-server_file") == 0) server_file = std::string(argv[i + 1]);
             if (strcmp(argv[i], "-warm_start") == 0) warm_start = true;
+            if (strcmp(argv[i], "-resume") == 0) resume = true;
+            if (strcmp(argv[i], "-resume_iteration") == 0) resume_iteration = atoi(argv[i + 1]);
+            if (strcmp(argv[i], "-checkpoint_interval") == 0) checkpoint_interval = atoi(argv[i + 1]);
+            if (strcmp(argv[i], "-checkpoint_dir") == 0) checkpoint_dir = std::string(argv[i + 1]);
+            if (strcmp(argv[i], "-export_interval") == 0) export_interval = atoi(argv[i + 1]);
+            if (strcmp(argv[i], "-export_dir") == 0) export_dir = std::string(argv[i + 1]);
+            if (strcmp(argv[i], "-export_text") == 0) export_text = true;
             if (strcmp(argv[i], "-out_of_core") == 0) out_of_core = true;
             if (strcmp(argv[i], "-word_init") == 0) word_init = true;
             if (strcmp(argv[i], "-data_capacity") == 0) data_capacity = atoi(argv[i + 1]) * kMB;
@@ -79,7 +95,8 @@ namespace multiverso { namespace lightlda
         printf("-alpha <arg>             Dirichlet prior alpha. Default: 0.1\n");
         printf("-beta <arg>              Dirichlet prior beta. Default: 0.01\n\n");
         printf("-num_blocks <arg>        Number of blocks in disk. Default: 1\n");
-        printf("-max_num_document <arg>  Max number of document in a data block \n");
+        printf("-max_num_document <arg>  Max number of document in a data block.\n");
+        printf("                         Optional, blocks are sized from file\n");
         printf("-input_dir <arg>         Directory of input data, containing\n");
         printf("                         files generated by dump_block \n\n");
         printf("-num_servers <arg>       Number of servers. Default: 1\n");
@@ -87,9 +104,24 @@ namespace multiverso { namespace lightlda
         printf("-num_aggregator <arg>    Number of local aggregation threads. Default: 1\n");
         printf("-server_file <arg>       Server endpoint file. Used by MPI-free version\n"); 
         printf("-warm_start              Warm start \n");
-        printf("-out_of_core             Use out of core computing \n\n");
-        printf("-data_capacity <arg>     Memory pool size(MB) for data storage, \n");
-        printf("                         should larger than the any data block\n");
+        printf("-resume                  Resume from the last checkpoint \n");
+        printf("-resume_iteration <arg>  Resume from the checkpoint of the\n");
+        printf("                         iteration, required with more than\n");
+        printf("                         one process\n");
+        printf("-checkpoint_interval <arg> Iterations between checkpoints.\n");
+        printf("                         Default: 0, no checkpoint\n");
+        printf("-checkpoint_dir <arg>    Directory of checkpoints.\n");
+        printf("                         Default: <input_dir>/checkpoint\n");
+        printf("-export_interval <arg>   Iterations between model exports, the\n");
+        printf("                         last iteration is always exported.\n");
+        printf("                         One process only. Default: 0, no export\n");
+        printf("-export_dir <arg>        Directory of model exports.\n");
+        printf("                         Default: <input_dir>/model\n");
+        printf("-export_text             Export the model as text files\n");
+        printf("-out_of_core             Use out of core computing \n");
+        printf("-num_io_threads <arg>    Number of threads to load and store\n");
+        printf("                         in-memory blocks. Default: 4\n\n");
+        printf("-data_capacity <arg>     Max size(MB) of a data block. Default: 1024\n");
         printf("-model_capacity <arg>    Memory pool size(MB) for local model cache\n");
         printf("-alias_capacity <arg>    Memory pool size(MB) for alias table \n");
         printf("-delta_capacity <arg>    Memory pool size(MB) for local delta cache\n");
@@ -106,14 +138,16 @@ namespace multiverso { namespace lightlda
         printf("-alpha <arg>             Dirichlet prior alpha. Default: 0.1\n");
         printf("-beta <arg>              Dirichlet prior beta. Default: 0.01\n\n");
         printf("-num_blocks <arg>        Number of blocks in disk. Default: 1\n");
-        printf("-max_num_document <arg>  Max number of document in a data block \n");
+        printf("-max_num_document <arg>  Max number of document in a data block.\n");
+        printf("                         Optional, blocks are sized from file\n");
         printf("-input_dir <arg>         Directory of input data, containing\n");
         printf("                         files generated by dump_block \n\n");
         printf("-num_local_workers <arg> Number of local training threads. Default: 4\n");
         printf("-warm_start              Warm start \n");
-        printf("-out_of_core             Use out of core computing \n\n");
-        printf("-data_capacity <arg>     Memory pool size(MB) for data storage, \n");
-        printf("                         should larger than the any data block\n");
+        printf("-out_of_core             Use out of core computing \n");
+        printf("-num_io_threads <arg>    Number of threads to load in-memory\n");
+        printf("                         blocks and the model. Default: 4\n\n");
+        printf("-data_capacity <arg>     Max size(MB) of a data block. Default: 1024\n");
         exit(0);
     }
 
@@ -131,10 +165,23 @@ namespace multiverso { namespace lightlda
 
     void Config::Check()
     {
-        if (input_dir == "" || num_vocabs <= 0 || max_num_document == -1) 
+        if (input_dir == "" || num_vocabs <= 0 || num_io_threads <= 0 ||
+            checkpoint_interval < 0 || export_interval < 0) 
         {
             PrintUsage();
         }
+        if (resume_iteration >= 0)
+        {
+            resume = true;
+        }
+        if (checkpoint_dir == "")
+        {
+            checkpoint_dir = input_dir + "/checkpoint";
+        }
+        if (export_dir == "")
+        {
+            export_dir = input_dir + "/model";
+        }
     }
 } // namespace lightlda
 } // namespace multiverso
@@ -6,6 +6,8 @@
 #ifndef LIGHTLDA_COMMON_H_
 #define LIGHTLDA_COMMON_H_
 
+#include "file_format.h"
+
 #include <cstdint>
 #include <string>
 #include <unordered_map>
@@ -20,6 +22,8 @@ namespace multiverso { namespace lightlda
     const int32_t kLoadFactor = 2;
     /*! \brief max length of a document */
     const int32_t kMaxDocLength = 8192;
+    /*! \brief binary model file in input_dir, loaded before text models */
+    const char* const kModelFileName = "model.bin";
 
     // 
     typedef int64_t DocNumber;
@@ -50,7 +54,9 @@ namespace multiverso { namespace lightlda
         static int32_t num_aggregator;
         /*! \brief number of blocks to train in disk */
         static int32_t num_blocks;
-        /*! \brief maximum number of documents in a block */
+        /*! \brief number of threads to load and store in-memory blocks */
+        static int32_t num_io_threads;
+        /*! \brief maximum number of documents in a block, -1 for no limit */
         static int64_t max_num_document;
         /*! \brief hyper-parameter for symmetric dirichlet prior */
         static float alpha;
@@ -62,6 +68,20 @@ namespace multiverso { namespace lightlda
         static std::string input_dir;
         /*! \brief option specify whether warm_start */
         static bool warm_start;
+        /*! \brief option specify whether resume from the last checkpoint */
+        static bool resume;
+        /*! \brief iteration of the checkpoint to resume, -1 for the last */
+        static int32_t resume_iteration;
+        /*! \brief number of iterations between checkpoints, 0 to disable */
+        static int32_t checkpoint_interval;
+        /*! \brief path of checkpoint directory */
+        static std::string checkpoint_dir;
+        /*! \brief number of iterations between model exports, 0 to disable */
+        static int32_t export_interval;
+        /*! \brief path of model export directory */
+        static std::string export_dir;
+        /*! \brief option specify whether export the model as text */
+        static bool export_text;
         /*! \brief inference mode */
         static bool inference;
         /*! \brief option specity whether use out of core computation */
@@ -1,62 +1,79 @@
 #include "data_block.h"
-#include "document.h"
 #include "common.h"
+#include "util.h"
 
 #include <multiverso/log.h>
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 
-#if defined(_WIN32) || defined(_WIN64)
-#include <Windows.h>
-#else 
-#include <stdio.h>
-#endif
-
-namespace
-{
-    void AtomicMoveFileExA(std::string existing_file, std::string new_file)
-    {
-#if defined(_WIN32) || defined(_WIN64)
-        MoveFileExA(existing_file.c_str(), new_file.c_str(),
-            MOVEFILE_REPLACE_EXISTING);
-#else 
-        if (rename(existing_file.c_str(), new_file.c_str()) == -1)
-        {
-            multiverso::Log::Error("Failed to move tmp file to final location\n");
-        }
-#endif
-    }
-}
-
 namespace multiverso { namespace lightlda
 {
     DataBlock::DataBlock()
-        : has_read_(false), num_document_(0), corpus_size_(0), vocab_(nullptr)
+        : has_read_(false), num_document_(0), offset_capacity_(0), 
+        offset_buffer_(nullptr), corpus_size_(0), documents_capacity_(0),
+        documents_buffer_(nullptr), vocab_(nullptr)
     {
+        memset(&header_, 0, sizeof(BlockHeader));
         max_num_document_ = Config::max_num_document;
         memory_block_size_ = Config::data_capacity / sizeof(int32_t);
+    }
 
-        documents_.resize(max_num_document_);
-        
-        try{
-            offset_buffer_ = new int64_t[max_num_document_];
-        }
-        catch (std::bad_alloc& ba) {
-            Log::Fatal("Bad Alloc caught: failed memory allocation for offset_buffer in DataBlock\n");
-        }
+    DataBlock::~DataBlock()
+    {
+        delete[] offset_buffer_;
+        delete[] documents_buffer_;
+    }
 
-        try{
-            documents_buffer_ = new int32_t[memory_block_size_];
+    void DataBlock::Reserve(DocNumber num_document, int64_t corpus_size)
+    {
+        if (num_document + 1 > offset_capacity_)
+        {
+            delete[] offset_buffer_;
+            offset_buffer_ = nullptr;
+            offset_capacity_ = 0;
+            try{
+                offset_buffer_ = new int64_t[num_document + 1];
+            }
+            catch (std::bad_alloc& ba) {
+                Log::Fatal("Bad Alloc caught: failed memory allocation for offset_buffer in DataBlock\n");
+            }
+            offset_capacity_ = num_document + 1;
         }
-        catch (std::bad_alloc& ba) {
-            Log::Fatal("Bad Alloc caught: failed memory allocation for documents_buffer in DataBlock\n");
+        if (corpus_size > documents_capacity_)
+        {
+            delete[] documents_buffer_;
+            documents_buffer_ = nullptr;
+            documents_capacity_ = 0;
+            try{
+                documents_buffer_ = new int32_t[corpus_size];
+            }
+            catch (std::bad_alloc& ba) {
+                Log::Fatal("Bad Alloc caught: failed memory allocation for documents_buffer in DataBlock\n");
+            }
+            documents_capacity_ = corpus_size;
         }
     }
 
-    DataBlock::~DataBlock()
+    void DataBlock::ComputeHeader(int32_t layout)
     {
-        delete[] offset_buffer_;
-        delete[] documents_buffer_;
+        memset(&header_, 0, sizeof(BlockHeader));
+        header_.magic = kBlockHeaderMagic;
+        header_.version = kFormatVersion;
+        header_.byte_order = kByteOrderMark;
+        header_.layout = layout;
+        header_.doc_num = num_document_;
+        header_.corpus_size = corpus_size_;
+        for (int32_t i = 0; i < num_document_; ++i)
+        {
+            int64_t doc_length = GetOneDoc(i).Size();
+            int32_t bin = 0;
+            while (bin + 1 < kDocLengthBins && (1LL << bin) <= doc_length) ++bin;
+            ++header_.doc_length_histogram[bin];
+            header_.token_num += doc_length;
+            header_.max_doc_length = std::max(header_.max_doc_length, doc_length);
+        }
     }
 
     void DataBlock::Read(std::string file_name)
@@ -68,18 +85,71 @@ namespace multiverso { namespace lightlda
         {
             Log::Fatal("Failed to read data %s\n", file_name_.c_str());
         }
-        block_file.read(reinterpret_cast<char*>(&num_document_), sizeof(DocNumber));
+        int64_t head = 0;
+        block_file.read(reinterpret_cast<char*>(&head), sizeof(int64_t));
+        // Positions of the offsets and the documents in the file
+        int64_t offsets_pos = 0;
+        int64_t documents_pos = 0;
+        bool has_header = (head == kBlockHeaderMagic);
+        if (has_header)
+        {
+            block_file.seekg(0);
+            block_file.read(reinterpret_cast<char*>(&header_), sizeof(BlockHeader));
+            if (!block_file.good())
+            {
+                Log::Fatal("Rank %d: Incomplete block file %s\n",
+                    Multiverso::ProcessRank(), file_name_.c_str());
+            }
+            if (header_.byte_order != kByteOrderMark)
+            {
+                Log::Fatal("Rank %d: Block file %s is of another byte order\n",
+                    Multiverso::ProcessRank(), file_name_.c_str());
+            }
+            if (header_.version > kFormatVersion || 
+                (header_.layout != kInterleavedLayout && 
+                header_.layout != kRunLengthLayout))
+            {
+                Log::Fatal("Rank %d: Unsupported version %d or layout %d of "
+                    "block file %s\n", Multiverso::ProcessRank(), header_.version,
+                    header_.layout, file_name_.c_str());
+            }
+            num_document_ = header_.doc_num;
+            documents_pos = sizeof(BlockHeader);
+            offsets_pos = documents_pos + sizeof(int32_t) * header_.corpus_size;
+        }
+        else
+        {
+            // Legacy blocks start with the document number, blocks being
+            // written start with a negative placeholder
+            if (head < 0)
+            {
+                Log::Fatal("Rank %d: Incomplete block file %s\n",
+                    Multiverso::ProcessRank(), file_name_.c_str());
+            }
+            num_document_ = head;
+            offsets_pos = sizeof(DocNumber);
+            documents_pos = offsets_pos + sizeof(int64_t) * (num_document_ + 1);
+        }
 
-        if (num_document_ > max_num_document_)
+        if (max_num_document_ > 0 && num_document_ > max_num_document_)
         {
             Log::Fatal("Rank %d: Num of documents > max number of documents when reading file %s\n", 
                 Multiverso::ProcessRank(), file_name_.c_str());
         }
 
+        // The offsets are read first, so the offset buffer is sized first
+        // and the document buffer once the corpus size is known
+        Reserve(num_document_, 0);
+        block_file.seekg(offsets_pos);
         block_file.read(reinterpret_cast<char*>(offset_buffer_),
             sizeof(int64_t)* (num_document_ + 1));
 
         corpus_size_ = offset_buffer_[num_document_];
+        if (has_header && corpus_size_ != header_.corpus_size)
+        {
+            Log::Fatal("Rank %d: Corrupted block file %s\n",
+                Multiverso::ProcessRank(), file_name_.c_str());
+        }
 
         if (corpus_size_ > memory_block_size_)
         {
@@ -87,17 +157,47 @@ namespace multiverso { namespace lightlda
                 Multiverso::ProcessRank(), file_name_.c_str());
         }
 
+        Reserve(num_document_, corpus_size_);
+        block_file.seekg(documents_pos);
         block_file.read(reinterpret_cast<char*>(documents_buffer_),
             sizeof(int32_t)* corpus_size_);
+        if (!block_file.good())
+        {
+            Log::Fatal("Rank %d: Failed to read documents of file %s\n",
+                Multiverso::ProcessRank(), file_name_.c_str());
+        }
         block_file.close();
 
-        GenerateDocuments();
+        if (!has_header)
+        {
+            ComputeHeader(kInterleavedLayout);
+        }
+        has_read_ = true;
+    }
+
+    void DataBlock::CopyFrom(const DataBlock& other)
+    {
+        Reserve(other.num_document_, other.corpus_size_);
+        num_document_ = other.num_document_;
+        corpus_size_ = other.corpus_size_;
+        header_ = other.header_;
+        memcpy(offset_buffer_, other.offset_buffer_,
+            sizeof(int64_t)* (num_document_ + 1));
+        memcpy(documents_buffer_, other.documents_buffer_,
+            sizeof(int32_t)* corpus_size_);
+        vocab_ = other.vocab_;
         has_read_ = true;
     }
 
     void DataBlock::Write()
     {
-        std::string temp_file = file_name_ + ".temp";
+        WriteTo(file_name_);
+        has_read_ = false;
+    }
+
+    void DataBlock::WriteTo(const std::string& file_name) const
+    {
+        std::string temp_file = file_name + ".temp";
 
         std::ofstream block_file(temp_file, std::ios::out | std::ios::binary);
 
@@ -106,27 +206,16 @@ namespace multiverso { namespace lightlda
             Log::Fatal("Failed to open file %s\n", temp_file.c_str());
         }
 
-        block_file.write(reinterpret_cast<char*>(&num_document_), 
-            sizeof(DocNumber));
-        block_file.write(reinterpret_cast<char*>(offset_buffer_),
-            sizeof(int64_t)* (num_document_ + 1));
+        block_file.write(reinterpret_cast<const char*>(&header_),
+            sizeof(BlockHeader));
         block_file.write(reinterpret_cast<char*>(documents_buffer_),
             sizeof(int32_t)* corpus_size_);
+        block_file.write(reinterpret_cast<char*>(offset_buffer_),
+            sizeof(int64_t)* (num_document_ + 1));
         block_file.flush();
         block_file.close();
 
-        AtomicMoveFileExA(temp_file, file_name_);
-        has_read_ = false;
-    }
-
-    void DataBlock::GenerateDocuments()
-    {
-        for (int32_t index = 0; index < num_document_; ++index)
-        {
-            documents_[index].reset(new Document(
-                documents_buffer_ + offset_buffer_[index],
-                documents_buffer_ + offset_buffer_[index + 1]));
-        }
+        AtomicMoveFile(temp_file, file_name);
     }
 } // namespace lightlda
 } // namespace multiverso
@@ -7,20 +7,20 @@
 #define LIGHTLDA_DATA_BLOCK_H_
 
 #include "common.h"
+#include "document.h"
 
 #include <multiverso/multiverso.h>
 
-#include <memory>
 #include <string>
-#include <vector>
 
 namespace multiverso { namespace lightlda
 {
-    class Document;
     class LocalVocab;
     /*!
      * \brief DataBlock is the an unit of the training dataset, 
-     *  it correspond to a data block file in disk. 
+     *  it correspond to a data block file in disk. Buffers are sized from
+     *  the block file header and only grow, so a DataBlock reused for 
+     *  several files ends up as large as the largest of them.
      */
     class DataBlock
     {
@@ -31,37 +31,56 @@ namespace multiverso { namespace lightlda
         void Read(std::string file_name);
         /*! \brief Writes a block of data to disk */
         void Write();
+        /*! \brief Writes a block of data to the given file, with header */
+        void WriteTo(const std::string& file_name) const;
+        /*! \brief Copies the documents and topics of another block */
+        void CopyFrom(const DataBlock& other);
         
         bool HasLoad() const;
 
         /*! \brief Gets the size (number of documents) of data block */
         DocNumber Size() const;
+        /*! \brief Gets the size in bytes of the block file */
+        int64_t ByteSize() const;
         /*!
          * \brief Gets one document
          * \param index index of document
-         * \return pointer to document
+         * \return a view of the document on the block memory
          */
-        Document* GetOneDoc(int32_t index);
+        Document GetOneDoc(int32_t index) const;
+        /*! \brief Whether documents are in run-length layout */
+        bool run_length() const;
+        /*! \brief Gets the number of tokens of all documents */
+        int64_t token_num() const;
+        /*! \brief Gets the header with the layout and statistics */
+        const BlockHeader& header() const;
 
         // mutator and accessor methods
         const LocalVocab& meta() const;
         void set_meta(const LocalVocab* local_vocab);
     private:
-        void GenerateDocuments();
+        /*! \brief Grows the buffers to hold num_document and corpus_size */
+        void Reserve(DocNumber num_document, int64_t corpus_size);
+        /*! \brief Computes the header of a block file without one */
+        void ComputeHeader(int32_t layout);
         bool has_read_;
-        /*! \brief size of memory pool for document offset */
+        /*! \brief upper bound of document number, -1 means no limit */
         int64_t max_num_document_;
-        /*! \brief size of memory pool for documents */
+        /*! \brief upper bound of corpus size (number of int32) */
         int64_t memory_block_size_;
-        /*! \brief index to each document */
-        std::vector<std::shared_ptr<Document>> documents_;
+        /*! \brief layout and statistics of the documents */
+        BlockHeader header_;
         /*! \brief number of document in this block */
         DocNumber num_document_;
-        /*! \brief memory pool to store the document offset */
+        /*! \brief allocated size of offset_buffer_ */
+        int64_t offset_capacity_;
+        /*! \brief memory to store the document offset */
         int64_t* offset_buffer_;
         /*! \brief actual memory size used */
         int64_t corpus_size_;
-        /*! \brief memory pool to store the documents */
+        /*! \brief allocated size of documents_buffer_ */
+        int64_t documents_capacity_;
+        /*! \brief memory to store the documents */
         int32_t* documents_buffer_;
         /*! \brief meta(vocabs) information of current data block */
         const LocalVocab* vocab_;
@@ -102,10 +121,17 @@ namespace multiverso { namespace lightlda
     // -- inline functions definition area --------------------------------- //
 
     inline bool DataBlock::HasLoad() const { return has_read_; }
-    inline Document* DataBlock::GetOneDoc(int32_t index)
+    inline Document DataBlock::GetOneDoc(int32_t index) const
     { 
-        return documents_[index].get(); 
+        return Document(documents_buffer_ + offset_buffer_[index],
+            documents_buffer_ + offset_buffer_[index + 1], run_length());
     }
+    inline bool DataBlock::run_length() const
+    {
+        return header_.layout == kRunLengthLayout;
+    }
+    inline int64_t DataBlock::token_num() const { return header_.token_num; }
+    inline const BlockHeader& DataBlock::header() const { return header_; }
     inline const LocalVocab& DataBlock::meta() const  { return *vocab_; }
     inline void DataBlock::set_meta(const LocalVocab* local_vocab)
     {
@@ -124,6 +150,11 @@ namespace multiverso { namespace lightlda
     inline DataBlock& LDADataBlock::data() { return *data_; }
     inline void LDADataBlock::set_data(DataBlock* data) { data_ = data; }
     inline DocNumber DataBlock::Size() const { return num_document_; }
+    inline int64_t DataBlock::ByteSize() const
+    {
+        return sizeof(BlockHeader) + sizeof(int64_t) * (num_document_ + 1)
+            + sizeof(int32_t) * corpus_size_;
+    }
 
     // -- inline functions definition area --------------------------------- //
 
@@ -1,11 +1,16 @@
 #include "data_stream.h"
 #include "common.h"
 #include "data_block.h"
+#include "util.h"
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
 #include <thread>
 
 #include <multiverso/double_buffer.h>
+#include <multiverso/log.h>
+#include <multiverso/stop_watch.h>
 
 namespace multiverso { namespace lightlda
 {
@@ -18,6 +23,14 @@ namespace multiverso { namespace lightlda
         virtual void EndDataAccess() override;
         virtual DataBlock& CurrDataBlock() override;
     private:
+        /*! 
+         * \brief Applies func to every block on num_io_threads threads
+         * \param name action name for logging
+         * \param func function applied to block id and block
+         */
+        template <typename Func>
+        void ParallelForBlocks(const char* name, Func func);
+
         std::vector<DataBlock*> data_buffer_;
         std::string data_path_;
         int32_t index_;
@@ -65,22 +78,46 @@ namespace multiverso { namespace lightlda
         : data_path_(data_path), index_(0)
     {
         data_buffer_.resize(num_blocks, nullptr);
-        for (int32_t i = 0; i < num_blocks; ++i)
+        ParallelForBlocks("Load", [this](int32_t i, DataBlock*& data)
         {
-            data_buffer_[i] = new DataBlock();
-            data_buffer_[i]->Read(data_path_ + "/block."
-                + std::to_string(i));
-        }
+            data = new DataBlock();
+            data->Read(data_path_ + "/block." + std::to_string(i));
+        });
     }
     MemoryDataStream::~MemoryDataStream()
     {
-        for (auto& data : data_buffer_)
+        ParallelForBlocks("Store", [](int32_t i, DataBlock*& data)
         {
             data->Write();
+        });
+        for (auto& data : data_buffer_)
+        {
             delete data;
             data = nullptr;
         }
     }
+
+    template <typename Func>
+    void MemoryDataStream::ParallelForBlocks(const char* name, Func func)
+    {
+        int32_t num_blocks = static_cast<int32_t>(data_buffer_.size());
+        int32_t num_threads = std::min(Config::num_io_threads, num_blocks);
+        std::atomic<int32_t> num_done(0);
+        std::atomic<int64_t> num_bytes(0);
+        StopWatch watch; watch.Start();
+        ParallelFor(num_blocks, num_threads, [&](int32_t i)
+        {
+            func(i, data_buffer_[i]);
+            num_bytes += data_buffer_[i]->ByteSize();
+            Log::Info("%s block %d done, %d/%d\n", name, i, 
+                ++num_done, num_blocks);
+        });
+        double seconds = watch.ElapsedSeconds();
+        Log::Info("%s %d blocks with %d threads: %.2f MB in %.2f s, %.2f MB/s\n",
+            name, num_blocks, num_threads, num_bytes / 1024.0 / 1024.0, seconds,
+            num_bytes / 1024.0 / 1024.0 / (seconds > 0 ? seconds : 1e-9));
+    }
+
     void MemoryDataStream::BeforeDataAccess()
     {
         index_ %= data_buffer_.size();
@@ -174,12 +211,12 @@ namespace multiverso { namespace lightlda
         }
     }
 
-    IDataStream* CreateDataStream()
+    IDataStream* CreateDataStream(int32_t num_iterations)
     {
         if (Config::out_of_core && Config::num_blocks != 1)
         {
             return new DiskDataStream(Config::num_blocks, Config::input_dir,
-                Config::num_iterations);
+                num_iterations);
         }
         else
         {
@@ -6,6 +6,8 @@
 #ifndef LIGHTLDA_DATA_STREAM_H_
 #define LIGHTLDA_DATA_STREAM_H_
 
+#include <cstdint>
+
 namespace multiverso { namespace lightlda 
 {
     class DataBlock;
@@ -25,8 +27,11 @@ namespace multiverso { namespace lightlda
         virtual DataBlock& CurrDataBlock() = 0;
     };
 
-    /*! \brief Factory method to create data stream */
-    IDataStream* CreateDataStream();
+    /*! 
+     * \brief Factory method to create data stream 
+     * \param num_iterations number of iterations the stream will serve
+     */
+    IDataStream* CreateDataStream(int32_t num_iterations);
     
 } // namespace lightlda
 } // namespace multiverso
@@ -5,17 +5,55 @@
 namespace multiverso { namespace lightlda
 {
     Document::Document(int32_t* begin, int32_t* end)
-        : begin_(begin), end_(end), cursor_(*begin_)
+        : Document(begin, end, false)
     {}
 
+    Document::Document(int32_t* begin, int32_t* end, bool run_length)
+        : begin_(begin), end_(end), runs_(nullptr),
+        run_(0), run_begin_(0), run_end_(0)
+    {
+        if (run_length)
+        {
+            int32_t num_runs = *(begin_ + 1);
+            runs_ = begin_ + 2;
+            topics_ = runs_ + 2 * num_runs;
+            stride_ = 1;
+            size_ = static_cast<int32_t>(end_ - topics_);
+            run_end_ = (num_runs > 0) ? runs_[1] : 0;
+        }
+        else
+        {
+            topics_ = begin_ + 2;
+            stride_ = 2;
+            size_ = static_cast<int32_t>((end_ - begin_) / 2);
+        }
+    }
+
+    void Document::SeekRun(int32_t index) const
+    {
+        if (index < run_begin_)
+        {
+            run_ = 0;
+            run_begin_ = 0;
+            run_end_ = runs_[1];
+        }
+        while (index >= run_end_)
+        {
+            ++run_;
+            run_begin_ = run_end_;
+            run_end_ += runs_[2 * run_ + 1];
+        }
+    }
+
     void Document::GetDocTopicVector(Row<int32_t>& topic_counter)
     {
-        int32_t* p = begin_ + 2;
+        int32_t* p = topics_;
+        int32_t* end = topics_ + size_ * stride_;
         int32_t num = 0;
-        while (p < end_)
+        while (p < end)
         {
             topic_counter.Add(*p, 1);
-            ++p; ++p;
+            p += stride_;
             if (++num == topic_counter.Capacity())
                 return;
         }
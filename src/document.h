@@ -16,10 +16,16 @@ namespace multiverso
 namespace multiverso { namespace lightlda
 {
     /*!
-     * \brief Document presents a document. Document doesn't own memory, but   
+     * \brief Document presents a document. Document doesn't own memory, but
      *  would interpret a contiguous piece of extern memory as a document
      *  with the format :
      *  #cursor, word1, topic1, word2, topic2, ..., wordn, topicn.#
+     *  or in run-length layout, with k distinct words and n tokens :
+     *  #cursor, k, word1, count1, ..., wordk, countk, topic1, ..., topicn.#
+     *  Both are accessed by token index in the same way. In run-length
+     *  layout the run of the last accessed token is cached, so words are
+     *  found in constant time when tokens are visited in order.
+     *  It is a light-weight view and is cheap to copy.
      */
     class Document
     {
@@ -28,6 +34,11 @@ namespace multiverso { namespace lightlda
          * \brief Constructs a document based on the start and end pointer
          */
         Document(int32_t* begin, int32_t* end);
+        /*!
+         * \brief Constructs a document based on the start and end pointer
+         * \param run_length whether the document is in run-length layout
+         */
+        Document(int32_t* begin, int32_t* end, bool run_length);
         /*! \brief Get the length of the document */
         int32_t Size() const;
         /*! \brief Get the word based on the index */
@@ -41,32 +52,42 @@ namespace multiverso { namespace lightlda
         /*! \brief Get the doc-topic vector */
         void GetDocTopicVector(Row<int32_t>& vec);
     private:
+        /*! \brief Moves the cached run to the one containing index */
+        void SeekRun(int32_t index) const;
+
         int32_t* begin_;
         int32_t* end_;
-        int32_t& cursor_;
-
-        // No copying allowed
-        Document(const Document&);
-        void operator=(const Document&);
+        /*! \brief topic of the first token, topics are stride_ apart */
+        int32_t* topics_;
+        int32_t stride_;
+        int32_t size_;
+        /*! \brief (word, count) pairs, nullptr if not in run-length layout */
+        int32_t* runs_;
+        /*! \brief cached run, holding tokens [run_begin_, run_end_) */
+        mutable int32_t run_;
+        mutable int32_t run_begin_;
+        mutable int32_t run_end_;
     };
 
     // -- inline functions definition area --------------------------------- //
-    inline int32_t Document::Size() const
-    {
-        return static_cast<int32_t>((end_ - begin_) / 2);
-    }
+    inline int32_t Document::Size() const { return size_; }
     inline int32_t Document::Word(int32_t index) const
     {
-        return *(begin_ + 1 + index * 2);
+        if (runs_ == nullptr)
+        {
+            return *(begin_ + 1 + index * 2);
+        }
+        if (index < run_begin_ || index >= run_end_) SeekRun(index);
+        return runs_[2 * run_];
     }
     inline int32_t Document::Topic(int32_t index) const
     {
-        return *(begin_ + 2 + index * 2);
+        return topics_[index * stride_];
     }
-    inline int32_t& Document::Cursor() { return cursor_; }
+    inline int32_t& Document::Cursor() { return *begin_; }
     inline void Document::SetTopic(int32_t index, int32_t topic)
     {
-        *(begin_ + 2 + index * 2) = topic;
+        topics_[index * stride_] = topic;
     }
     // -- inline functions definition area --------------------------------- //
 
@@ -0,0 +1,110 @@
+/*!
+ * \file file_format.h
+ * \brief Defines the headers of the block, vocab and binary model files.
+ *  Depends on the standard library only, so the preprocessing tools share
+ *  it with training and inference, see preprocess/block_format.h
+ */
+
+#ifndef LIGHTLDA_FILE_FORMAT_H_
+#define LIGHTLDA_FILE_FORMAT_H_
+
+#include <cstdint>
+
+namespace multiverso { namespace lightlda
+{
+    /*!
+     * \brief first 8 bytes of a block file with a BlockHeader. Legacy block
+     *  files start with the document number, which is never negative
+     */
+    const int64_t kBlockHeaderMagic = -0x4C44414B4C48;
+    /*! \brief first 8 bytes of a vocab file with a VocabHeader */
+    const int64_t kVocabHeaderMagic = -0x4C44414B4C56;
+    /*! \brief first 8 bytes of a binary model file, see ModelFileHeader */
+    const int64_t kModelMagic = -0x4C44414B4C4D;
+    /*! \brief magic of a header until its file is complete, never read */
+    const int64_t kIncompleteMagic = -1;
+    /*! \brief latest version of the block, vocab and model file headers */
+    const int32_t kFormatVersion = 1;
+    /*! \brief reads as another value on a machine of the other byte order */
+    const int32_t kByteOrderMark = 0x01020304;
+    /*! \brief document layouts of a block, see Document */
+    const int32_t kInterleavedLayout = 0;
+    const int32_t kRunLengthLayout = 1;
+    /*! \brief number of log2 bins of the document length histogram */
+    const int32_t kDocLengthBins = 16;
+
+    /*!
+     * \brief BlockHeader starts a block file of version 1, followed by the
+     *  documents (int32 * corpus_size) and the document offsets
+     *  (int64 * (doc_num + 1)). It records the layout and statistics of
+     *  the block, so readers size and plan without scanning documents.
+     *  Block files without it are still read, and their header is computed
+     */
+    struct BlockHeader
+    {
+        /*! \brief kBlockHeaderMagic */
+        int64_t magic;
+        int32_t version;
+        /*! \brief kByteOrderMark as written */
+        int32_t byte_order;
+        /*! \brief kInterleavedLayout or kRunLengthLayout */
+        int32_t layout;
+        int32_t reserved;
+        int64_t doc_num;
+        int64_t token_num;
+        /*! \brief number of int32 of the documents */
+        int64_t corpus_size;
+        int64_t max_doc_length;
+        /*! \brief number of documents of length 0, 1, [2, 4), [4, 8) ... */
+        int64_t doc_length_histogram[kDocLengthBins];
+    };
+
+    /*!
+     * \brief VocabHeader starts a vocab file of version 1, followed by the
+     *  words, their global tf and their tf in the block (int32 * size).
+     *  Vocab files without it start with the size (int32)
+     */
+    struct VocabHeader
+    {
+        /*! \brief kVocabHeaderMagic */
+        int64_t magic;
+        int32_t version;
+        /*! \brief kByteOrderMark as written */
+        int32_t byte_order;
+        int32_t size;
+        /*! \brief largest word of the vocab, -1 if empty */
+        int32_t max_word;
+        /*! \brief number of tokens of the block */
+        int64_t token_num;
+    };
+
+    /*!
+     * \brief ModelFileHeader starts a binary model file, followed by the
+     *  row offsets (int64 * (num_words + 1)), the topics and the counts of
+     *  the non-zero entries (int32 * nnz each) and the summary row
+     *  (int64 * num_topics). Row w holds entries [offsets[w], offsets[w + 1])
+     *  with topics in ascending order
+     */
+    struct ModelFileHeader
+    {
+        /*! \brief kModelMagic */
+        int64_t magic;
+        int32_t version;
+        /*! \brief kByteOrderMark as written */
+        int32_t byte_order;
+        int32_t num_words;
+        int32_t num_topics;
+        int64_t nnz;
+    };
+
+    // The headers are written as they are in memory, their layout must not
+    // depend on the compiler
+    static_assert(sizeof(BlockHeader) == 56 + 8 * kDocLengthBins,
+        "unexpected size of BlockHeader");
+    static_assert(sizeof(VocabHeader) == 32, "unexpected size of VocabHeader");
+    static_assert(sizeof(ModelFileHeader) == 32,
+        "unexpected size of ModelFileHeader");
+} // namespace lightlda
+} // namespace multiverso
+
+#endif // LIGHTLDA_FILE_FORMAT_H_
@@ -1,10 +1,13 @@
 ﻿#include "common.h"
 #include "trainer.h"
 #include "alias_table.h"
+#include "checkpoint.h"
 #include "data_stream.h"
 #include "data_block.h"
 #include "document.h"
 #include "meta.h"
+#include "model_export.h"
+#include "scheduler.h"
 #include "util.h"
 #include <vector>
 #include <iostream>
@@ -23,12 +26,18 @@ namespace multiverso { namespace lightlda
             
             AliasTable* alias_table = new AliasTable();
             Barrier* barrier = new Barrier(Config::num_local_workers);
+            DocScheduler* scheduler = new DocScheduler(Config::num_local_workers);
             meta.Init();
+            if (Config::export_interval > 0)
+            {
+                exporter = new ModelExport(Config::export_dir, &meta);
+            }
             std::vector<TrainerBase*> trainers;
 	    // trainer 只是本地的线程数！！
             for (int32_t i = 0; i < Config::num_local_workers; ++i)
             {
-                Trainer* trainer = new Trainer(alias_table, barrier, &meta);
+                Trainer* trainer = new Trainer(alias_table, barrier, &meta,
+                    scheduler, exporter);
                 trainers.push_back(trainer);
             }
 
@@ -44,10 +53,32 @@ namespace multiverso { namespace lightlda
             Log::ResetLogFile("LightLDA."
                 + std::to_string(clock()) + ".log");
 
-            data_stream = CreateDataStream();
+            // A process only knows the words of its own blocks, so the rows
+            // of a word would be exported by every process holding it
+            if (exporter != nullptr && Multiverso::TotalProcessCount() > 1)
+            {
+                Log::Fatal("Model export supports only one process, "
+                    "got %d\n", Multiverso::TotalProcessCount());
+            }
+
+            if (Config::resume || Config::checkpoint_interval > 0)
+            {
+                checkpoint = new Checkpoint(Config::checkpoint_dir);
+            }
+            if (Config::resume)
+            {
+                Resume(trainers);
+            }
+
+            data_stream = CreateDataStream(
+                Config::num_iterations - start_iteration);
             InitMultiverso();
-            Train();
-	    // DumpModel(trainers);
+            Train(trainers);
+            delete checkpoint;
+            checkpoint = nullptr;
+            // waits for the last export to be written
+            delete exporter;
+            exporter = nullptr;
 
             Multiverso::Close();
             
@@ -60,15 +91,24 @@ namespace multiverso { namespace lightlda
             DumpDocTopic();
 
             delete data_stream;
+            delete scheduler;
             delete barrier;
             delete alias_table;
         }
     private:
-        static void Train()
+        static void Train(std::vector<TrainerBase*>& trainers)
         {
             Multiverso::BeginTrain();
-            for (int32_t i = 0; i < Config::num_iterations; ++i)
+            for (int32_t i = start_iteration; i < Config::num_iterations; ++i)
             {
+                bool do_checkpoint = Config::checkpoint_interval > 0 &&
+                    (i + 1) % Config::checkpoint_interval == 0 &&
+                    i + 1 < Config::num_iterations;
+                if (do_checkpoint) checkpoint->Begin(i + 1);
+                bool do_export = Config::export_interval > 0 &&
+                    ((i + 1) % Config::export_interval == 0 ||
+                    i + 1 == Config::num_iterations);
+                if (do_export) exporter->Begin(i + 1);
                 Multiverso::BeginClock();
                 // Train corpus block by block
                 for (int32_t block = 0; block < Config::num_blocks; ++block)
@@ -90,13 +130,69 @@ namespace multiverso { namespace lightlda
                         Multiverso::PushDataBlock(lda_block);
                     }
                     Multiverso::Wait();
+                    if (do_checkpoint) checkpoint->AddBlock(block, data_block);
                     data_stream->EndDataAccess();
                 }
+                if (do_checkpoint)
+                {
+                    std::vector<uint32_t> rng_states;
+                    for (auto& trainer : trainers)
+                    {
+                        rng_states.push_back(
+                            static_cast<Trainer*>(trainer)->rng().state());
+                    }
+                    checkpoint->Commit(rng_states);
+                }
+                if (do_export) exporter->Commit();
                 Multiverso::EndClock();
             }
             Multiverso::EndTrain();
         }
 
+        static void Resume(std::vector<TrainerBase*>& trainers)
+        {
+            if (!checkpoint->HasCommitted())
+            {
+                Log::Fatal("No checkpoint to resume in %s\n",
+                    Config::checkpoint_dir.c_str());
+            }
+            // Processes checkpoint independently, only the user can pick
+            // an iteration all of them hold
+            if (Config::resume_iteration < 0 &&
+                Multiverso::TotalProcessCount() > 1)
+            {
+                Log::Fatal("Resume of %d processes needs -resume_iteration, "
+                    "the smallest last checkpoint iteration of them\n",
+                    Multiverso::TotalProcessCount());
+            }
+            if (!checkpoint->Select(Config::resume_iteration))
+            {
+                Log::Fatal("Rank = %d, no checkpoint of iteration %d to "
+                    "resume in %s\n", Multiverso::ProcessRank(),
+                    Config::resume_iteration, Config::checkpoint_dir.c_str());
+            }
+            start_iteration = checkpoint->iteration();
+            for (int32_t block = 0; block < Config::num_blocks; ++block)
+            {
+                checkpoint->RestoreBlock(block, Config::input_dir 
+                    + "/block." + std::to_string(block));
+            }
+            const std::vector<uint32_t>& rng_states = checkpoint->rng_states();
+            if (rng_states.size() == trainers.size())
+            {
+                for (size_t i = 0; i < trainers.size(); ++i)
+                {
+                    static_cast<Trainer*>(trainers[i])->rng().set_state(
+                        rng_states[i]);
+                }
+            }
+            else
+            {
+                Log::Info("Number of trainers changed, rng states are not restored\n");
+            }
+            Log::Info("Resume from checkpoint, iteration = %d\n", start_iteration);
+        }
+
         static void InitMultiverso()
         {
             Multiverso::BeginConfig();
@@ -120,31 +216,34 @@ namespace multiverso { namespace lightlda
                 DataBlock& data_block = data_stream->CurrDataBlock();
                 int32_t num_slice = meta.local_vocab(block).num_slice();
                 Log::Info("block %d/%d, num_slice=%d, data_block_size=%d\n", block + 1, Config::num_blocks, num_slice, data_block.Size());
-                for (int32_t i = 0; i < data_block.Size(); ++i)
+                // On resume the tables are rebuilt from the aggregated 
+                // word-topic counts of checkpoint instead of every token
+                if (Config::resume) checkpoint->RestoreTables(block);
+                for (int32_t i = 0; i < data_block.Size() && !Config::resume; ++i)
                 {
                     // 一个完整的 doc 一定在一个 data_block 中
-                    Document* doc = data_block.GetOneDoc(i);
+                    Document doc = data_block.GetOneDoc(i);
                     int32_t max_word_id = 0;
-                    for (int32_t word_idx = 0; word_idx < doc->Size(); ++word_idx) {
-                        if (doc->Word(word_idx) > max_word_id) max_word_id = doc->Word(word_idx);
+                    for (int32_t word_idx = 0; word_idx < doc.Size(); ++word_idx) {
+                        if (doc.Word(word_idx) > max_word_id) max_word_id = doc.Word(word_idx);
                     }
                     int32_t doc_topic_id = max_word_id % Config::num_topics;
-                    for (int32_t word_idx = 0; word_idx < doc->Size(); ++word_idx) {
+                    for (int32_t word_idx = 0; word_idx < doc.Size(); ++word_idx) {
                       // Init the latent variable
                       if (!Config::warm_start) {
                           if (Config::word_init) {
                               // use word_id as topic_id
-                              doc->SetTopic(word_idx, doc->Word(word_idx));
+                              doc.SetTopic(word_idx, doc.Word(word_idx));
                           } else {
-                              doc->SetTopic(word_idx, doc_topic_id);
+                              doc.SetTopic(word_idx, doc_topic_id);
                           }
                       }
                       // Init the server table
                       // word_id 和 topic_id 都是从 0 开始
                       Multiverso::AddToServer<int32_t>(kWordTopicTable,
-                          doc->Word(word_idx), doc->Topic(word_idx), 1);
+                          doc.Word(word_idx), doc.Topic(word_idx), 1);
                       Multiverso::AddToServer<int64_t>(kSummaryRow,
-                          0, doc->Topic(word_idx), 1);
+                          0, doc.Topic(word_idx), 1);
                     }
                 }
                 Multiverso::Flush();
@@ -162,9 +261,9 @@ namespace multiverso { namespace lightlda
                 DataBlock& data_block = data_stream->CurrDataBlock();
                 for (int i = 0; i < data_block.Size(); ++i)
                 {
-                    Document* doc = data_block.GetOneDoc(i);
+                    Document doc = data_block.GetOneDoc(i);
                     doc_topic_counter.Clear();
-                    doc->GetDocTopicVector(doc_topic_counter);
+                    doc.GetDocTopicVector(doc_topic_counter);
                     fout << i << " ";  // doc id
                     Row<int32_t>::iterator iter = doc_topic_counter.Iterator();
                     while (iter.HasNext())
@@ -178,25 +277,6 @@ namespace multiverso { namespace lightlda
             }
         }
 
-	// static void DumpModel(std::vector<TrainerBase*>& trainers) {
-	//     int32_t num_vocabs = Config::num_vocabs;
-	//     TrainerBase* trainer = trainers[0];
-	//     std::string out = "model.out";
-	//     std::ofstream fout(out);
-	//     for (int word = 0; word < num_vocabs; ++word) {
-	//         Row<int32_t>& row = trainer->GetRow<int32_t>(kWordTopicTable, word);
-	// 	Row<int32_t>::iterator iter = row.Iterator();
-	// 	fout << word;
-	// 	while (iter.HasNext()) {
-	// 	    int32_t topic = iter.Key();
-	// 	    int32_t count = iter.Value();
-	// 	    fout << " " << topic << ":" << count;
-	// 	    iter.Next();
-	// 	}
-	// 	fout << std::endl;
-	//     }
-	// }
-
         static void CreateTable()
         {
             int32_t num_vocabs = Config::num_vocabs;
@@ -257,9 +337,18 @@ namespace multiverso { namespace lightlda
         static IDataStream* data_stream;
         /*! \brief training data meta information */
         static Meta meta;
+        /*! \brief checkpoint of training state, nullptr if not enabled */
+        static Checkpoint* checkpoint;
+        /*! \brief model export, nullptr if not enabled */
+        static ModelExport* exporter;
+        /*! \brief first iteration to train, non-zero when resume */
+        static int32_t start_iteration;
     };
     IDataStream* LightLDA::data_stream = nullptr;
     Meta LightLDA::meta;
+    Checkpoint* LightLDA::checkpoint = nullptr;
+    ModelExport* LightLDA::exporter = nullptr;
+    int32_t LightLDA::start_iteration = 0;
 
 } // namespace lightlda
 } // namespace multiverso
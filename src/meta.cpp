@@ -1,13 +1,62 @@
 #include "meta.h"
 #include "common.h"
+#include "util.h"
 
-#include <fstream>
+#include <algorithm>
+#include <cstring>
 #include <multiverso/log.h>
+#include <multiverso/multiverso.h>
+#include <multiverso/stop_watch.h>
 
 namespace multiverso { namespace lightlda
 {
+    namespace
+    {
+        /*! \brief memory in bytes and tokens of words in a slice */
+        struct SliceCost
+        {
+            int64_t model;
+            int64_t alias;
+            int64_t delta;
+            int64_t tokens;
+        };
+
+        /*!
+         * \brief Cuts words into slices, a slice ends before the word making
+         *  it exceed a capacity or max_tokens, unless it is the first word.
+         * \return index of the first word of each slice, then costs.size()
+         */
+        std::vector<int32_t> CutSlices(const std::vector<SliceCost>& costs,
+            int64_t max_tokens)
+        {
+            std::vector<int32_t> slice_index(1, 0);
+            SliceCost total = {};
+            int32_t size = static_cast<int32_t>(costs.size());
+            for (int32_t j = 0; j < size; ++j)
+            {
+                const SliceCost& cost = costs[j];
+                if (j > slice_index.back() &&
+                    (total.model + cost.model > Config::model_capacity ||
+                    total.alias + cost.alias > Config::alias_capacity ||
+                    total.delta + cost.delta > Config::delta_capacity ||
+                    total.tokens + cost.tokens > max_tokens))
+                {
+                    slice_index.push_back(j);
+                    total = SliceCost();
+                }
+                total.model += cost.model;
+                total.alias += cost.alias;
+                total.delta += cost.delta;
+                total.tokens += cost.tokens;
+            }
+            slice_index.push_back(size);
+            return slice_index;
+        }
+    } // namespace
+
     LocalVocab::LocalVocab() 
-        : num_slices_(0), own_memory_(false), vocabs_(nullptr), size_(0)
+        : num_slices_(0), own_memory_(false), vocabs_(nullptr), size_(0),
+        token_num_(0)
     {}
 
     LocalVocab::~LocalVocab()
@@ -18,25 +67,51 @@ namespace multiverso { namespace lightlda
         }
     }
 
-    AliasTableIndex::AliasTableIndex()
+    AliasTableIndex::AliasTableIndex(const int32_t* begin, const int32_t* end)
+        : first_word_(begin == end ? 0 : *begin)
     {
-        index_map_.resize(Config::num_vocabs, -1);
+        if (begin != end)
+        {
+            int64_t range = *(end - 1) - first_word_ + 1;
+            bits_.resize((range + 63) / 64, 0);
+            ranks_.resize(bits_.size(), 0);
+            for (const int32_t* p = begin; p != end; ++p)
+            {
+                int32_t pos = *p - first_word_;
+                bits_[pos >> 6] |= 1ULL << (pos & 63);
+            }
+            int32_t rank = 0;
+            for (size_t i = 0; i < bits_.size(); ++i)
+            {
+                ranks_[i] = rank;
+#ifdef _MSC_VER
+                rank += static_cast<int32_t>(__popcnt64(bits_[i]));
+#else
+                rank += __builtin_popcountll(bits_[i]);
+#endif
+            }
+        }
+        index_.reserve(end - begin);
     }
 
-    WordEntry& AliasTableIndex::word_entry(int32_t word)
+    void AliasTableIndex::WordNotFound(int32_t word) const
     {
-        if (index_map_[word] == -1)
-        {
-            Log::Fatal("Fatal in alias index: word %d not exist\n", word);
-        }
-        return index_[index_map_[word]];
+        Log::Fatal("Fatal in alias index: word %d not exist\n", word);
     }
 
     void AliasTableIndex::PushWord(int32_t word,
         bool is_dense, int64_t begin_offset, int32_t capacity)
     {
-        index_map_[word] = static_cast<int>(index_.size());
-        index_.push_back({ is_dense, begin_offset, capacity });
+        if (Rank(word) != static_cast<int32_t>(index_.size()))
+        {
+            Log::Fatal("Fatal in alias index: word %d pushed out of order\n",
+                word);
+        }
+        WordEntry entry;
+        entry.begin_offset = begin_offset;
+        entry.capacity = capacity;
+        entry.is_dense = is_dense;
+        index_.push_back(entry);
     }
 
     Meta::Meta()
@@ -52,56 +127,59 @@ namespace multiverso { namespace lightlda
                 delete alias_index_[i][j];
             }
         }
+        for (int32_t i = 0; i < vocab_files_.size(); ++i)
+        {
+            delete vocab_files_[i];
+        }
     }
 
     void Meta::Init()
     {
+        StopWatch watch; watch.Start();
         tf_.resize(Config::num_vocabs, 0);
         local_tf_.resize(Config::num_vocabs, 0);
-        int32_t* tf = new int32_t[Config::num_vocabs];
-        int32_t* local_tf = new int32_t[Config::num_vocabs];
 		local_vocabs_.resize(Config::num_blocks);
-        for (int32_t i = 0; i < Config::num_blocks; ++i)
+        block_tf_.resize(Config::num_blocks, nullptr);
+        vocab_files_.resize(Config::num_blocks, nullptr);
+        std::vector<const int32_t*> tf(Config::num_blocks);
+        int32_t num_threads = std::max(1, Config::num_io_threads);
+        ParallelFor(Config::num_blocks, 
+            std::min(num_threads, Config::num_blocks), [&](int32_t i)
         {
-            LocalVocab& local_vocab = local_vocabs_[i];
-
-            std::string file_name = Config::input_dir 
-                + "/vocab." + std::to_string(i);
-            std::ifstream vocab_file(file_name, std::ios::in|std::ios::binary);
-
-            if (!vocab_file.good())
-            {
-                Log::Fatal("Failed to open file : %s\n", file_name.c_str());
-            }
-
-            vocab_file.read(reinterpret_cast<char*>(&local_vocab.size_),
-                sizeof(int));
-            local_vocab.vocabs_ = new int[local_vocab.size_];
-            local_vocab.own_memory_ = true;
-            vocab_file.read(reinterpret_cast<char*>(local_vocab.vocabs_), 
-                sizeof(int)*  local_vocab.size_);
-            vocab_file.read(reinterpret_cast<char*>(tf), 
-                sizeof(int)*  local_vocab.size_);
-            vocab_file.read(reinterpret_cast<char*>(local_tf),
-                sizeof(int)*  local_vocab.size_);
+            tf[i] = LoadVocab(i);
+        });
 
-            vocab_file.close();
-
-            for (int32_t i = 0; i < local_vocab.size_; ++i)
+        // Words of a vocab are ascending, each thread merges the tf of a
+        // range of words from all blocks
+        ParallelFor(num_threads, num_threads, [&](int32_t thread)
+        {
+            int32_t first = static_cast<int32_t>(
+                static_cast<int64_t>(Config::num_vocabs) * thread / num_threads);
+            int32_t last = static_cast<int32_t>(
+                static_cast<int64_t>(Config::num_vocabs) * (thread + 1) 
+                / num_threads);
+            for (int32_t i = 0; i < Config::num_blocks; ++i)
             {
-                if (tf[i] > tf_[local_vocab.vocabs_[i]])
+                const LocalVocab& local_vocab = local_vocabs_[i];
+                const int32_t* words = local_vocab.vocabs_;
+                const int32_t* words_end = words + local_vocab.size_;
+                for (const int32_t* p = std::lower_bound(words, words_end,
+                    first); p != words_end && *p < last; ++p)
                 {
-                    tf_[local_vocab.vocabs_[i]] = tf[i];
-                }
-                if (local_tf[i] > local_tf_[local_vocab.vocabs_[i]])
-                {
-                    local_tf_[local_vocab.vocabs_[i]] = local_tf[i];
+                    int64_t j = p - words;
+                    tf_[*p] = std::max(tf_[*p], tf[i][j]);
+                    local_tf_[*p] = std::max(local_tf_[*p], block_tf_[i][j]);
                 }
             }
+        });
+        int64_t token_num = 0;
+        for (int32_t i = 0; i < Config::num_blocks; ++i)
+        {
+            token_num += local_vocabs_[i].token_num_;
         }
-
-        delete[] local_tf;
-        delete[] tf;
+        Log::Info("Rank = %d, %lld tokens in %d blocks, vocabs loaded in "
+            "%.2f s\n", Multiverso::ProcessRank(), token_num, 
+            Config::num_blocks, watch.ElapsedSeconds());
 
         if(!Config::inference)
         {
@@ -111,132 +189,241 @@ namespace multiverso { namespace lightlda
         {
             ModelSchedule4Inference();
         }
-        BuildAliasIndex();
+        alias_index_.resize(Config::num_blocks);
+        for (int32_t i = 0; i < Config::num_blocks; ++i)
+        {
+            alias_index_[i].resize(local_vocabs_[i].num_slice(), nullptr);
+        }
     }
 
-    void Meta::ModelSchedule()
+    const int32_t* Meta::LoadVocab(int32_t block)
     {
-        int64_t model_capacity = Config::model_capacity;
-        int64_t alias_capacity = Config::alias_capacity;
-        int64_t delta_capacity = Config::delta_capacity;
+        LocalVocab& local_vocab = local_vocabs_[block];
+        std::string file_name = Config::input_dir 
+            + "/vocab." + std::to_string(block);
+        MappedFile* vocab_file = new MappedFile();
+        vocab_files_[block] = vocab_file;
+        if (!vocab_file->Open(file_name) || vocab_file->data() == nullptr)
+        {
+            Log::Fatal("Failed to open file : %s\n", file_name.c_str());
+        }
+        const char* data = vocab_file->data();
+        int64_t file_size = vocab_file->size();
+
+        VocabHeader header;
+        int64_t offset = 0;
+        bool has_header = file_size >= sizeof(int64_t) &&
+            memcmp(data, &kVocabHeaderMagic, sizeof(int64_t)) == 0;
+        if (has_header)
+        {
+            if (file_size < sizeof(VocabHeader))
+            {
+                Log::Fatal("Failed to read vocab file : %s\n", file_name.c_str());
+            }
+            memcpy(&header, data, sizeof(VocabHeader));
+            if (header.byte_order != kByteOrderMark || 
+                header.version > kFormatVersion)
+            {
+                Log::Fatal("Unsupported version %d or byte order of vocab "
+                    "file : %s\n", header.version, file_name.c_str());
+            }
+            offset = sizeof(VocabHeader);
+        }
+        else
+        {
+            // Vocab files without header start with the size
+            if (file_size < sizeof(int32_t))
+            {
+                Log::Fatal("Failed to read vocab file : %s\n", file_name.c_str());
+            }
+            memcpy(&header.size, data, sizeof(int32_t));
+            offset = sizeof(int32_t);
+        }
+        if (header.size < 0 || 
+            file_size < offset + 3 * sizeof(int32_t) * header.size)
+        {
+            Log::Fatal("Failed to read vocab file : %s\n", file_name.c_str());
+        }
+        // words, global tf and local tf, read in place
+        const int32_t* words = reinterpret_cast<const int32_t*>(data + offset);
+        const int32_t* tf = words + header.size;
+        const int32_t* local_tf = tf + header.size;
+        local_vocab.size_ = header.size;
+        local_vocab.vocabs_ = const_cast<int32_t*>(words);
+        local_vocab.own_memory_ = false;
+        block_tf_[block] = local_tf;
+
+        int32_t max_word = -1;
+        int64_t token_num = 0;
+        for (int32_t j = 0; j < header.size; ++j)
+        {
+            if (words[j] <= max_word)
+            {
+                Log::Fatal("Words of vocab file %s are not ascending\n",
+                    file_name.c_str());
+            }
+            max_word = words[j];
+            token_num += local_tf[j];
+        }
+        if (!has_header)
+        {
+            header.max_word = max_word;
+            header.token_num = token_num;
+        }
+        if (header.max_word >= Config::num_vocabs)
+        {
+            Log::Fatal("Word %d of vocab file %s is out of -num_vocabs %d\n",
+                header.max_word, file_name.c_str(), Config::num_vocabs);
+        }
+        local_vocab.token_num_ = header.token_num;
+        return tf;
+    }
 
+    void Meta::ModelSchedule()
+    {
         int32_t model_thresh = Config::num_topics / (2 * kLoadFactor);
         int32_t alias_thresh = (Config::num_topics * 2) / 3;
         int32_t delta_thresh = Config::num_topics / (4 * kLoadFactor);
 
-
+        int32_t num_slices = 0;
 		// Schedule for each data block
         for (int32_t i = 0; i < Config::num_blocks; ++i)
 		{
 			LocalVocab& local_vocab = local_vocabs_[i];
             int32_t* vocabs = local_vocab.vocabs_;
-			local_vocab.slice_index_.push_back(0);
+            const int32_t* block_tf = block_tf_[i];
 
-            int64_t model_offset = 0;
-            int64_t alias_offset = 0;
-            int64_t delta_offset = 0;
+            std::vector<SliceCost> costs(local_vocab.size_);
             for (int32_t j = 0; j < local_vocab.size_; ++j)
 			{
                 int32_t word = vocabs[j];
-                int32_t tf = tf_[word];
-                int32_t local_tf = local_tf_[word];
-                int32_t model_size = (tf > model_thresh) ?
-                    Config::num_topics* sizeof(int32_t) :
+                int64_t tf = tf_[word];
+                int64_t local_tf = local_tf_[word];
+                SliceCost& cost = costs[j];
+                cost.model = (tf > model_thresh) ?
+                    Config::num_topics * sizeof(int32_t) :
                     tf * kLoadFactor * sizeof(int32_t);
-                model_offset += model_size;
-
-                int32_t alias_size = (tf > alias_thresh) ?
+                cost.alias = (tf > alias_thresh) ?
                     Config::num_topics * 2 * sizeof(int32_t) :
                     tf * 3 * sizeof(int32_t);
-                alias_offset += alias_size;
-
-                int32_t delta_size = (local_tf > delta_thresh) ?
+                cost.delta = (local_tf > delta_thresh) ?
                     Config::num_topics * sizeof(int32_t) :
                     local_tf * kLoadFactor * 2 * sizeof(int32_t);
-                delta_offset += delta_size;
+                cost.tokens = block_tf[j];
+			}
 
-                if (model_offset > model_capacity ||
-                    alias_offset > alias_capacity ||
-                    delta_offset > delta_capacity)
+            // The memory decides the fewest slices, then the smallest token
+            // limit keeping that many slices balances the tokens among them,
+            // so no slice is left with a small tail of the block
+            int64_t max_tokens = local_vocab.token_num_;
+            std::vector<int32_t> slice_index = CutSlices(costs, max_tokens);
+            int32_t num_block_slices = 
+                static_cast<int32_t>(slice_index.size()) - 1;
+            if (num_block_slices > 1)
+            {
+                int64_t low = (local_vocab.token_num_ + num_block_slices - 1)
+                    / num_block_slices;
+                int64_t high = max_tokens;
+                while (low < high)
                 {
-                    Log::Info("Actual Model capacity: %d MB, Alias capacity: %d MB, Delta capacity: %dMB\n",
-                        model_offset/1024/1024, alias_offset/1024/1024, delta_offset/1024/1024);
-                    local_vocab.slice_index_.push_back(j);
-                    ++local_vocab.num_slices_;
-                    model_offset = model_size;
-                    alias_offset = alias_size;
-                    delta_offset = delta_size;
+                    int64_t mid = low + (high - low) / 2;
+                    if (CutSlices(costs, mid).size() <= slice_index.size())
+                    {
+                        high = mid;
+                    }
+                    else
+                    {
+                        low = mid + 1;
+                    }
                 }
-			}
-            local_vocab.slice_index_.push_back(local_vocab.size_);
-            ++local_vocab.num_slices_;
-            Log::Info("INFO: block = %d, the number of slice = %d\n",
-                i, local_vocab.num_slices_);
+                max_tokens = low;
+                slice_index = CutSlices(costs, max_tokens);
+            }
+            local_vocab.slice_index_ = slice_index;
+            local_vocab.num_slices_ = num_block_slices;
+            local_vocab.slice_token_num_.assign(num_block_slices, 0);
+            num_slices += num_block_slices;
+
+            // Schedule report
+            for (int32_t slice = 0; slice < num_block_slices; ++slice)
+            {
+                SliceCost total = {};
+                for (int32_t j = slice_index[slice]; 
+                    j < slice_index[slice + 1]; ++j)
+                {
+                    total.model += costs[j].model;
+                    total.alias += costs[j].alias;
+                    total.delta += costs[j].delta;
+                    total.tokens += costs[j].tokens;
+                }
+                local_vocab.slice_token_num_[slice] = total.tokens;
+                Log::Info("Rank = %d, block = %d, slice = %d, words = %d, "
+                    "tokens = %lld, model = %lld MB, alias = %lld MB, "
+                    "delta = %lld MB\n", Multiverso::ProcessRank(), i, slice,
+                    slice_index[slice + 1] - slice_index[slice], total.tokens,
+                    total.model / 1024 / 1024, total.alias / 1024 / 1024,
+                    total.delta / 1024 / 1024);
+            }
+            Log::Info("Rank = %d, block = %d, the number of slice = %d, "
+                "tokens = %lld, max tokens of a slice = %lld\n",
+                Multiverso::ProcessRank(), i, num_block_slices,
+                local_vocab.token_num_, max_tokens);
 		}
+        Log::Info("Rank = %d, expected %d slices per iteration in %d blocks\n",
+            Multiverso::ProcessRank(), num_slices, Config::num_blocks);
+        block_tf_.clear();
     }
 
     void Meta::ModelSchedule4Inference()
     {
-        Config::alias_capacity = 0;
-        int32_t alias_thresh = (Config::num_topics * 2) / 3;
-        // Schedule for each data block
+        // Schedule for each data block, one slice of the whole vocab. The
+        // alias capacity is planned from the model, see AliasTable::Capacity
         for (int32_t i = 0; i < Config::num_blocks; ++i)
         {
             LocalVocab& local_vocab = local_vocabs_[i];
-            int32_t* vocabs = local_vocab.vocabs_;
             local_vocab.slice_index_.push_back(0);
             local_vocab.slice_index_.push_back(local_vocab.size_);
             local_vocab.num_slices_ = 1;
-            int64_t alias_offset = 0;
-            for (int32_t j = 0; j < local_vocab.size_; ++j)
-            {
-                int32_t word = vocabs[j];
-                int32_t tf = tf_[word];
-                int32_t alias_size = (tf > alias_thresh) ?
-                    Config::num_topics * 2 * sizeof(int32_t) :
-                    tf * 3 * sizeof(int32_t);
-                alias_offset += alias_size;
-            }
-            if(alias_offset > Config::alias_capacity)
-            {
-                Config::alias_capacity = alias_offset;
-            }
+            local_vocab.slice_token_num_.assign(1, local_vocab.token_num_);
+        }
+        block_tf_.clear();
+    }
+
+    AliasTableIndex* Meta::alias_index(int32_t block, int32_t slice)
+    {
+        std::lock_guard<std::mutex> lock(alias_index_mutex_);
+        AliasTableIndex*& index = alias_index_[block][slice];
+        if (index == nullptr)
+        {
+            index = BuildAliasIndex(block, slice);
         }
-        Log::Info("Actual Alias capacity: %d MB\n", Config::alias_capacity/1024/1024);
+        return index;
     }
 
-    void Meta::BuildAliasIndex()
+    AliasTableIndex* Meta::BuildAliasIndex(int32_t block, int32_t slice)
     {
         int32_t alias_thresh = (Config::num_topics * 2) / 3;
-        alias_index_.resize(Config::num_blocks);
-        // for each block
-        for (int32_t i = 0; i < Config::num_blocks; ++i)
+        const LocalVocab& vocab = local_vocab(block);
+        AliasTableIndex* index = new AliasTableIndex(vocab.begin(slice),
+            vocab.end(slice));
+        int64_t offset = 0;
+        for (const int32_t* p = vocab.begin(slice);
+            p != vocab.end(slice); ++p)
         {
-            const LocalVocab& vocab = local_vocab(i);
-            alias_index_[i].resize(vocab.num_slice());
-            // for each slice
-            for (int32_t j = 0; j < vocab.num_slice(); ++j)
+            int32_t word = *p;
+            bool is_dense = true;
+            int32_t capacity = Config::num_topics;
+            int64_t size = Config::num_topics * 2;
+            if (tf(word) <= alias_thresh)
             {
-                alias_index_[i][j] = new AliasTableIndex();
-                int64_t offset = 0;
-                for (const int32_t* p = vocab.begin(j);
-                    p != vocab.end(j); ++p)
-                {
-                    int32_t word = *p;
-                    bool is_dense = true;
-                    int32_t capacity = Config::num_topics;
-                    int64_t size = Config::num_topics * 2;
-                    if (tf(word) <= alias_thresh)
-                    {
-                        is_dense = false;
-                        capacity = tf(word);
-                        size = tf(word) * 3;
-                    }
-                    alias_index_[i][j]->PushWord(word, is_dense, offset, capacity);
-                    offset += size;
-                }
+                is_dense = false;
+                capacity = tf(word);
+                size = tf(word) * 3;
             }
+            index->PushWord(word, is_dense, offset, capacity);
+            offset += size;
         }
+        return index;
     }
 
 } // namespace lightlda
@@ -9,6 +9,12 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <mutex>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "file_format.h"
 
 namespace multiverso { namespace lightlda
 {
@@ -30,34 +36,61 @@ namespace multiverso { namespace lightlda
         const int* begin(int32_t slice) const;
         /*! \brief Get the pointer to last word + 1 in this slice */
         const int32_t* end(int32_t slice) const;
+        /*! \brief Get the number of tokens of the block */
+        int64_t token_num() const;
+        /*! \brief Get the number of tokens of the block in the slice */
+        int64_t slice_token_num(int32_t slice) const;
     private:
         int32_t num_slices_;
         bool own_memory_;
         int32_t* vocabs_;
         int32_t size_;
+        int64_t token_num_;
         std::vector<int32_t> slice_index_;
+        std::vector<int64_t> slice_token_num_;
     };
 
 
+    /*! \brief WordEntry locates the alias row of a word, 16 bytes */
     struct WordEntry
     {
-        bool is_dense;
         int64_t begin_offset;
         int32_t capacity;
+        bool is_dense;
     };
 
+    /*!
+     * \brief AliasTableIndex maps the words of a slice to their entries.
+     *  The words of a slice are ascending, so a bitmap of the words from
+     *  the first word of the slice and the number of words before each 64
+     *  bits of it give the entry of a word, in about 1.5 bits per word id
+     *  of the slice range instead of an int32 per word of the vocabulary
+     */
     class AliasTableIndex
     {
     public:
-        AliasTableIndex();
+        /*! \brief Creates the index of the ascending words [begin, end) */
+        AliasTableIndex(const int32_t* begin, const int32_t* end);
         WordEntry& word_entry(int32_t word);
+        /*! \brief Adds the entry of the next word, in ascending order */
         void PushWord(int32_t word, bool is_dense,
             int64_t begin_offset, int32_t capacity);
     private:
+        /*! \brief Position of word in index_, -1 if not in the slice */
+        int32_t Rank(int32_t word) const;
+        /*! \brief Reports a word not in the slice, does not return */
+        void WordNotFound(int32_t word) const;
+
+        int32_t first_word_;
+        /*! \brief bit i is set if first_word_ + i is in the slice */
+        std::vector<uint64_t> bits_;
+        /*! \brief number of words before each 64 bits of bits_ */
+        std::vector<int32_t> ranks_;
         std::vector<WordEntry> index_;
-        std::vector<int32_t> index_map_;
     };
 
+    class MappedFile;
+
     /*!
      * \brief Meta containes all the meta information of training data in 
      *  current process. It containes 1) all the local vacabs for all data
@@ -68,7 +101,10 @@ namespace multiverso { namespace lightlda
     public:
         Meta();
         ~Meta();
-        /*! \brief Initialize the Meta information */
+        /*! 
+         * \brief Initialize the Meta information, the vocab files are 
+         *  mapped and read on num_io_threads threads
+         */
         void Init();
         /*! \brief Get the tf of word in the whole dataset */
         int32_t tf(int32_t word) const;
@@ -77,14 +113,24 @@ namespace multiverso { namespace lightlda
         /*! \brief Get the local vocab based on block id */
         const LocalVocab& local_vocab(int32_t id) const;
 
+        /*! 
+         * \brief Get the alias index of a slice, built when the slice is
+         *  first asked for
+         */
         AliasTableIndex* alias_index(int32_t block, int32_t slice);
     private:
-        /*! \brief Schedule the model and split as slices based on memory */
+        /*! \brief Maps vocab file of block, return its global tf */
+        const int32_t* LoadVocab(int32_t block);
+        /*!
+         * \brief Schedule the model and split as slices based on memory,
+         *  with the fewest slices the memory allows and tokens balanced
+         *  among them
+         */
         void ModelSchedule();
         /*! \brief Schedule the model without vocabulary sliptting */
         void ModelSchedule4Inference();
-        /*! \brief Build index for alias table */
-        void BuildAliasIndex();
+        /*! \brief Build index for alias table of a slice */
+        AliasTableIndex* BuildAliasIndex(int32_t block, int32_t slice);
     private:
         /*! \brief meta information for all data block */
         std::vector<LocalVocab> local_vocabs_;
@@ -92,8 +138,13 @@ namespace multiverso { namespace lightlda
         std::vector<int32_t> tf_;
         /*! \brief local tf information for all word in this machine */
         std::vector<int32_t> local_tf_;
+        /*! \brief tf of the words of each block, kept until scheduled */
+        std::vector<const int32_t*> block_tf_;
+        /*! \brief mapped vocab files, holding the words of local vocabs */
+        std::vector<MappedFile*> vocab_files_;
 
         std::vector<std::vector<AliasTableIndex*> > alias_index_;
+        std::mutex alias_index_mutex_;
         // No copying allowed
         Meta(const Meta&);
         void operator=(const Meta&);
@@ -113,16 +164,39 @@ namespace multiverso { namespace lightlda
     {
         return vocabs_ + slice_index_[slice + 1];
     }
+    inline int64_t LocalVocab::token_num() const { return token_num_; }
+    inline int64_t LocalVocab::slice_token_num(int32_t slice) const
+    {
+        return slice_token_num_[slice];
+    }
+    inline int32_t AliasTableIndex::Rank(int32_t word) const
+    {
+        uint32_t pos = static_cast<uint32_t>(word - first_word_);
+        if (pos >= bits_.size() * 64) return -1;
+        uint64_t bits = bits_[pos >> 6];
+        if (!((bits >> (pos & 63)) & 1)) return -1;
+        bits &= (1ULL << (pos & 63)) - 1;
+#ifdef _MSC_VER
+        return ranks_[pos >> 6] + static_cast<int32_t>(__popcnt64(bits));
+#else
+        return ranks_[pos >> 6] + __builtin_popcountll(bits);
+#endif
+    }
+    inline WordEntry& AliasTableIndex::word_entry(int32_t word)
+    {
+        int32_t rank = Rank(word);
+        if (rank == -1)
+        {
+            WordNotFound(word);
+        }
+        return index_[rank];
+    }
     inline int32_t Meta::tf(int32_t word) const { return tf_[word]; }
     inline int32_t Meta::local_tf(int32_t word) const { return local_tf_[word]; }
     inline const LocalVocab& Meta::local_vocab(int32_t id) const
     {
         return local_vocabs_[id]; 
     }
-    inline AliasTableIndex* Meta::alias_index(int32_t block, int32_t slice)
-    {
-        return alias_index_[block][slice];
-    }
     // -- inline functions definition area --------------------------------- //
 
 } // namespace lightlda
@@ -8,196 +8,561 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <limits>
 #include <sstream>
+#include <thread>
 
 #include "meta.h"
 #include "trainer.h"
 
 #include <multiverso/log.h>
 #include <multiverso/multiverso.h>
+#include <multiverso/stop_watch.h>
 
 namespace multiverso { namespace lightlda
 {
-    LocalModel::LocalModel(Meta * meta) : word_topic_table_(nullptr),
-        summary_table_(nullptr), meta_(meta)
+    namespace
     {
-        CreateTable();
+        /*! \brief rows of a word topic table file, before set to the table */
+        struct ModelShard
+        {
+            std::vector<int32_t> words;
+            /*! \brief row i holds entries [offsets[i], offsets[i + 1]) */
+            std::vector<int64_t> offsets;
+            std::vector<int32_t> topics;
+            std::vector<int32_t> counts;
+            int64_t num_bytes;
+        };
+
+        /*! \brief Parses a topic:count pair of a line of model */
+        bool ParseFeature(const char*& ptr, int32_t& topic_id, int64_t& freq)
+        {
+            char* end;
+            long topic = strtol(ptr, &end, 10);
+            if (end == ptr || *end != ':') return false;
+            ptr = end + 1;
+            long long count = strtoll(ptr, &end, 10);
+            if (end == ptr || (*end != '\0' && !isspace(*end))) return false;
+            ptr = end;
+            topic_id = static_cast<int32_t>(topic);
+            freq = count;
+            return true;
+        }
+
+        /*! \brief Reads the rows of the words in the vocabulary of meta */
+        void ParseWordTopicFile(const std::string& model_fname, 
+            const Meta* meta, ModelShard& shard)
+        {
+            std::ifstream model_file(model_fname, std::ios::in);
+            if (!model_file.good())
+            {
+                Log::Fatal("Failed to open model file %s\n", model_fname.c_str());
+            }
+            shard.offsets.push_back(0);
+            shard.num_bytes = 0;
+            std::string line;
+            while (getline(model_file, line))
+            {
+                shard.num_bytes += line.size() + 1;
+                const char* ptr = line.c_str();
+                char* end;
+                long word_id = strtol(ptr, &end, 10);
+                if (end == ptr || word_id < 0)
+                {
+                    Log::Fatal("bad word id of model: %s\n", line.c_str());
+                }
+                if (word_id >= Config::num_vocabs || 
+                    meta->tf(static_cast<int32_t>(word_id)) <= 0)
+                {
+                    continue;
+                }
+                ptr = end;
+                while (isspace(*ptr)) ++ptr;
+                while (*ptr != '\0')
+                {
+                    int32_t topic_id;
+                    int64_t freq;
+                    if (!ParseFeature(ptr, topic_id, freq) || 
+                        topic_id < 0 || topic_id >= Config::num_topics ||
+                        freq < INT32_MIN || freq > INT32_MAX)
+                    {
+                        Log::Fatal("bad format of model: %s\n", line.c_str());
+                    }
+                    shard.topics.push_back(topic_id);
+                    shard.counts.push_back(static_cast<int32_t>(freq));
+                    while (isspace(*ptr)) ++ptr;
+                }
+                shard.words.push_back(static_cast<int32_t>(word_id));
+                shard.offsets.push_back(shard.topics.size());
+            }
+            model_file.close();
+        }
+
+        /*! 
+         * \brief Parses the word topic table files on num_threads threads
+         * \return number of bytes read
+         */
+        int64_t ParseWordTopicFiles(const std::vector<std::string>& model_fnames,
+            const Meta* meta, int32_t num_threads, std::vector<ModelShard>& shards)
+        {
+            int32_t num_files = static_cast<int32_t>(model_fnames.size());
+            shards.resize(num_files);
+            std::atomic<int32_t> num_done(0);
+            ParallelFor(num_files, num_threads, [&](int32_t i)
+            {
+                ParseWordTopicFile(model_fnames[i], meta, shards[i]);
+                Log::Info("loading word topic table[%s] done, %d/%d\n",
+                    model_fnames[i].c_str(), ++num_done, num_files);
+            });
+            int64_t num_bytes = 0;
+            for (auto& shard : shards)
+            {
+                num_bytes += shard.num_bytes;
+            }
+            return num_bytes;
+        }
+
+        /*! \brief Adds the counts of the summary row in a summary table file */
+        void ParseSummaryFile(const std::string& model_fname,
+            std::vector<int64_t>& summary)
+        {
+            std::ifstream model_file(model_fname, std::ios::in);
+            std::string line;
+            if (getline(model_file, line))
+            {
+                const char* ptr = line.c_str();
+                //skip word id
+                while (*ptr != '\0' && !isspace(*ptr)) ++ptr;
+                while (isspace(*ptr)) ++ptr;
+                while (*ptr != '\0')
+                {
+                    int32_t topic_id;
+                    int64_t freq;
+                    if (!ParseFeature(ptr, topic_id, freq) || 
+                        topic_id < 0 || topic_id >= Config::num_topics)
+                    {
+                        Log::Fatal("bad format of model: %s\n", line.c_str());
+                    }
+                    summary[topic_id] += freq;
+                    while (isspace(*ptr)) ++ptr;
+                }
+            }
+            model_file.close();
+        }
+
+#ifndef _MSC_VER
+        /*! \brief Lists the word topic and summary table files in input_dir */
+        void ListModelFiles(std::vector<std::string>& wordtopic_fnames,
+            std::vector<std::string>& summary_fnames)
+        {
+            //set regex for model files
+            regex_t model_wordtopic_regex;
+            regex_t model_summary_regex;
+            std::string prefix = "server_[[:digit:]]+_table_";
+            std::string suffix = ".model";
+            std::ostringstream wordtopic_regstr;
+            wordtopic_regstr << prefix << kWordTopicTable << suffix;
+            std::ostringstream summary_regstr;
+            summary_regstr << prefix << kSummaryRow << suffix;
+            regcomp(&model_wordtopic_regex, wordtopic_regstr.str().c_str(), REG_EXTENDED);
+            regcomp(&model_summary_regex, summary_regstr.str().c_str(), REG_EXTENDED);
+
+            //look for model files
+            DIR *dir;
+            struct dirent *ent;
+            if ((dir = opendir(Config::input_dir.c_str())) != NULL)
+            {
+                while ((ent = readdir(dir)) != NULL)
+                {
+                    if (!regexec(&model_wordtopic_regex, ent->d_name, 0, NULL, 0))
+                    {
+                        wordtopic_fnames.push_back(Config::input_dir + "/" + ent->d_name);
+                    }
+                    else if (!regexec(&model_summary_regex, ent->d_name, 0, NULL, 0))
+                    {
+                        summary_fnames.push_back(Config::input_dir + "/" + ent->d_name);
+                    }
+                }
+                closedir(dir);
+            }
+            else
+            {
+                Log::Fatal("model dir does not exist : %s\n", Config::input_dir.c_str());
+            }
+            regfree(&model_wordtopic_regex);
+            regfree(&model_summary_regex);
+            std::sort(wordtopic_fnames.begin(), wordtopic_fnames.end());
+            std::sort(summary_fnames.begin(), summary_fnames.end());
+        }
+#endif
     }
 
-    void LocalModel::Init()
+    ModelFile::ModelFile() : offsets_(nullptr), topics_(nullptr),
+        counts_(nullptr), summary_(nullptr)
     {
-        LoadTable();
+        memset(&header_, 0, sizeof(ModelFileHeader));
     }
 
-    void LocalModel::CreateTable()
+    bool ModelFile::Open(const std::string& file_name)
     {
-        int32_t num_vocabs = Config::num_vocabs;
-        int32_t num_topics = Config::num_topics;
-        multiverso::Format dense_format = multiverso::Format::Dense;
-        Type int_type = Type::Int;
-        Type longlong_type = Type::LongLong;
-
-        word_topic_table_.reset(new Table(kWordTopicTable, num_vocabs, num_topics,
-            int_type, dense_format));
-        summary_table_.reset(new Table(kSummaryRow, 1, num_topics,
-            longlong_type, dense_format));
+        if (!file_.Open(file_name))
+        {
+            return false;
+        }
+        if (file_.size() < sizeof(ModelFileHeader))
+        {
+            Log::Fatal("Invalid model file %s\n", file_name.c_str());
+        }
+        memcpy(&header_, file_.data(), sizeof(ModelFileHeader));
+        if (header_.magic != kModelMagic)
+        {
+            Log::Fatal("Not a binary model file %s\n", file_name.c_str());
+        }
+        if (header_.byte_order != kByteOrderMark || 
+            header_.version > kFormatVersion)
+        {
+            Log::Fatal("Unsupported version %d or byte order of model file %s\n",
+                header_.version, file_name.c_str());
+        }
+        int64_t size = sizeof(ModelFileHeader)
+            + sizeof(int64_t) * (header_.num_words + 1)
+            + sizeof(int32_t) * 2 * header_.nnz
+            + sizeof(int64_t) * header_.num_topics;
+        if (header_.num_words < 0 || header_.num_topics < 0 || 
+            header_.nnz < 0 || file_.size() != size)
+        {
+            Log::Fatal("Invalid model file %s\n", file_name.c_str());
+        }
+        const char* p = file_.data() + sizeof(ModelFileHeader);
+        offsets_ = reinterpret_cast<const int64_t*>(p);
+        p += sizeof(int64_t) * (header_.num_words + 1);
+        topics_ = reinterpret_cast<const int32_t*>(p);
+        p += sizeof(int32_t) * header_.nnz;
+        counts_ = reinterpret_cast<const int32_t*>(p);
+        p += sizeof(int32_t) * header_.nnz;
+        summary_ = reinterpret_cast<const int64_t*>(p);
+        // the offsets between are checked while scanning the rows
+        if (offsets_[0] != 0 || offsets_[header_.num_words] != header_.nnz)
+        {
+            Log::Fatal("Invalid model file %s\n", file_name.c_str());
+        }
+        return true;
     }
 
-    void LocalModel::LoadTable()
+    CompactModel::CompactModel(Meta* meta) : meta_(meta), num_words_(0),
+        offsets_(nullptr), topics_(nullptr), counts_(nullptr), summary_(nullptr)
+    {}
+
+    void CompactModel::Init()
     {
-#ifdef _MSC_VER
-        Log::Fatal("Not implementent yet on Windows\n");
-#else
         Log::Info("loading model\n");
-        //set regex for model files
-        regex_t model_wordtopic_regex;
-        regex_t model_summary_regex;
-        std::string prefix = "server_[[:digit:]]+_table_";
-        std::string suffix = ".model";
-        std::ostringstream wordtopic_regstr;
-        wordtopic_regstr << prefix << kWordTopicTable << suffix;
-        std::ostringstream summary_regstr;
-        summary_regstr << prefix << kSummaryRow << suffix;
-        regcomp(&model_wordtopic_regex, wordtopic_regstr.str().c_str(), REG_EXTENDED);
-        regcomp(&model_summary_regex, summary_regstr.str().c_str(), REG_EXTENDED);
-
-        //look for model files & load them
-        DIR *dir;
-        struct dirent *ent;
-        if ((dir = opendir(Config::input_dir.c_str())) != NULL)
-        {
-            while ((ent = readdir(dir)) != NULL)
-            {
-                if (!regexec(&model_wordtopic_regex, ent->d_name, 0, NULL, 0))
-                {
-                    Log::Info("loading word topic table[%s]\n", ent->d_name);
-                    LoadWordTopicTable(Config::input_dir + "/" + ent->d_name);
-                }
-                else if (!regexec(&model_summary_regex, ent->d_name, 0, NULL, 0))
+        StopWatch watch; watch.Start();
+        std::string model_fname = Config::input_dir + "/" + kModelFileName;
+        if (model_file_.Open(model_fname))
+        {
+            if (model_file_.num_topics() != Config::num_topics)
+            {
+                Log::Fatal("Model file %s has %d topics, not -num_topics %d\n",
+                    model_fname.c_str(), model_file_.num_topics(), 
+                    Config::num_topics);
+            }
+            num_words_ = std::min(model_file_.num_words(), Config::num_vocabs);
+            offsets_ = model_file_.offsets();
+            topics_ = model_file_.RowTopics(0);
+            counts_ = model_file_.RowCounts(0);
+            summary_ = model_file_.summary();
+            // lookups rely on offsets in range, ascending topics and 
+            // non-zero counts
+            int32_t num_threads = std::max(1, Config::num_io_threads);
+            int64_t nnz = model_file_.nnz();
+            ParallelFor(num_threads, num_threads, [&](int32_t part)
+            {
+                for (int32_t word_id = part; word_id < num_words_; 
+                    word_id += num_threads)
                 {
-                    Log::Info("loading summary table[%s]\n", ent->d_name);
-                    LoadSummaryTable(Config::input_dir + "/" + ent->d_name);
+                    if (offsets_[word_id] > offsets_[word_id + 1] || 
+                        offsets_[word_id + 1] > nnz || 
+                        offsets_[word_id + 1] - offsets_[word_id] > 
+                        Config::num_topics)
+                    {
+                        Log::Fatal("bad offsets of word %d in model: %s\n",
+                            word_id, model_fname.c_str());
+                    }
+                    for (int64_t k = offsets_[word_id]; 
+                        k < offsets_[word_id + 1]; ++k)
+                    {
+                        if (topics_[k] < 0 || topics_[k] >= Config::num_topics ||
+                            (k > offsets_[word_id] && topics_[k] <= topics_[k - 1])
+                            || counts_[k] == 0)
+                        {
+                            Log::Fatal("bad row of word %d in model: %s\n",
+                                word_id, model_fname.c_str());
+                        }
+                    }
                 }
-            }
-            closedir(dir);
+            });
+            Log::Info("mapped binary model[%s], %lld entries\n",
+                model_fname.c_str(), model_file_.nnz());
         }
         else
         {
-            Log::Fatal("model dir does not exist : %s\n", Config::input_dir.c_str());
+            LoadTextTable();
         }
-        regfree(&model_wordtopic_regex);
-        regfree(&model_summary_regex);
-#endif
+        SetRows();
+
+        // memory besides the topics and offsets mapped from model.bin
+        int64_t num_bytes = sizeof(int32_t) * (row_index_.size() + 
+            dense_counts_.size() + topics_buffer_.size() + wide_counts_.size())
+            + sizeof(uint16_t) * (short_dense_counts_.size() + 
+            short_counts_.size()) + short_rows_.size()
+            + sizeof(int64_t) * (offsets_buffer_.size() + 
+            summary_buffer_.size() + short_offsets_.size() + 
+            wide_offsets_.size());
+        Log::Info("compact model: %d words, %lld entries, %lld dense rows, "
+            "%.2f MB in memory, loaded in %.2f s\n", num_words_, 
+            offsets_[num_words_], static_cast<int64_t>((dense_counts_.size()
+            + short_dense_counts_.size()) / Config::num_topics),
+            num_bytes / 1024.0 / 1024.0, watch.ElapsedSeconds());
     }
 
-    void LocalModel::LoadWordTopicTable(const std::string& model_fname)
+    void CompactModel::LoadTextTable()
     {
-        multiverso::Format dense_format = multiverso::Format::Dense;
-        multiverso::Format sparse_format = multiverso::Format::Sparse;
-        std::ifstream model_file(model_fname, std::ios::in);
-        std::string line;
-        while (getline(model_file, line))
-        {
-            std::stringstream ss(line);
-            std::string word;
-            std::string fea;
-            std::vector<std::string> feas;
-            int32_t word_id, topic_id, freq;
-            //assign word id
-            ss >> word;
-            word_id = std::stoi(word);
-            if (meta_->tf(word_id) > 0)
-            {
-                //set row
-                if (meta_->tf(word_id) * kLoadFactor > Config::num_topics)
+#ifdef _MSC_VER
+        Log::Fatal("Text model not implementent yet on Windows, "
+            "convert it to %s with convert_model\n", kModelFileName);
+#else
+        std::vector<std::string> wordtopic_fnames;
+        std::vector<std::string> summary_fnames;
+        ListModelFiles(wordtopic_fnames, summary_fnames);
+        int32_t num_threads = std::max(1, Config::num_io_threads);
+        std::vector<ModelShard> shards;
+        StopWatch watch; watch.Start();
+        int64_t num_bytes = ParseWordTopicFiles(wordtopic_fnames, meta_,
+            num_threads, shards);
+
+        // entries of a word in several files are put together, then each
+        // row is sorted, with the counts of the same topic merged
+        num_words_ = Config::num_vocabs;
+        offsets_buffer_.assign(num_words_ + 1, 0);
+        for (auto& shard : shards)
+        {
+            for (int32_t j = 0; j < shard.words.size(); ++j)
+            {
+                offsets_buffer_[shard.words[j] + 1] += 
+                    shard.offsets[j + 1] - shard.offsets[j];
+            }
+        }
+        for (int32_t word_id = 0; word_id < num_words_; ++word_id)
+        {
+            offsets_buffer_[word_id + 1] += offsets_buffer_[word_id];
+        }
+        topics_buffer_.resize(offsets_buffer_[num_words_]);
+        counts_buffer_.resize(offsets_buffer_[num_words_]);
+        std::vector<int64_t> row_end(offsets_buffer_.begin(), 
+            offsets_buffer_.end() - 1);
+        for (auto& shard : shards)
+        {
+            for (int32_t j = 0; j < shard.words.size(); ++j)
+            {
+                int64_t& end = row_end[shard.words[j]];
+                for (int64_t k = shard.offsets[j]; k < shard.offsets[j + 1]; ++k)
                 {
-                    word_topic_table_->SetRow(word_id, dense_format, 
-                        Config::num_topics);
+                    topics_buffer_[end] = shard.topics[k];
+                    counts_buffer_[end] = shard.counts[k];
+                    ++end;
                 }
-                else
+            }
+            shard = ModelShard();
+        }
+
+        std::vector<int32_t> row_size(num_words_, 0);
+        ParallelFor(num_threads, num_threads, [&](int32_t part)
+        {
+            std::vector<std::pair<int32_t, int32_t>> entries;
+            for (int32_t word_id = part; word_id < num_words_; 
+                word_id += num_threads)
+            {
+                int64_t begin = offsets_buffer_[word_id];
+                entries.clear();
+                for (int64_t k = begin; k < offsets_buffer_[word_id + 1]; ++k)
                 {
-                    word_topic_table_->SetRow(word_id, sparse_format, 
-                        meta_->tf(word_id) * kLoadFactor);
+                    entries.push_back(std::make_pair(topics_buffer_[k], 
+                        counts_buffer_[k]));
                 }
-                //get row
-                Row<int32_t> * row = static_cast<Row<int32_t>*>
-                    (word_topic_table_->GetRow(word_id));
-
-                //add features to row
-                while (ss >> fea)
+                std::sort(entries.begin(), entries.end());
+                int32_t size = 0;
+                for (int32_t i = 0; i < entries.size(); ++i)
                 {
-                    size_t pos = fea.find_last_of(':');
-                    if (pos != std::string::npos)
+                    if (size > 0 && topics_buffer_[begin + size - 1] == 
+                        entries[i].first)
                     {
-                        topic_id = std::stoi(fea.substr(0, pos));
-                        freq = std::stoi(fea.substr(pos + 1));
-                        row->Add(topic_id, freq);
+                        counts_buffer_[begin + size - 1] += entries[i].second;
+                        if (counts_buffer_[begin + size - 1] == 0) --size;
                     }
-                    else
+                    else if (entries[i].second != 0)
                     {
-                        Log::Fatal("bad format of model: %s\n", line.c_str());
+                        topics_buffer_[begin + size] = entries[i].first;
+                        counts_buffer_[begin + size] = entries[i].second;
+                        ++size;
                     }
                 }
+                row_size[word_id] = size;
+            }
+        });
+        // closes the gaps left by merged entries
+        int64_t nnz = 0;
+        for (int32_t word_id = 0; word_id < num_words_; ++word_id)
+        {
+            int64_t begin = offsets_buffer_[word_id];
+            offsets_buffer_[word_id] = nnz;
+            for (int32_t i = 0; i < row_size[word_id]; ++i)
+            {
+                topics_buffer_[nnz] = topics_buffer_[begin + i];
+                counts_buffer_[nnz] = counts_buffer_[begin + i];
+                ++nnz;
             }
         }
-        model_file.close();
+        offsets_buffer_[num_words_] = nnz;
+        topics_buffer_.resize(nnz);
+        topics_buffer_.shrink_to_fit();
+        counts_buffer_.resize(nnz);
+        counts_buffer_.shrink_to_fit();
+
+        summary_buffer_.assign(Config::num_topics, 0);
+        for (auto& summary_fname : summary_fnames)
+        {
+            Log::Info("loading summary table[%s]\n", summary_fname.c_str());
+            ParseSummaryFile(summary_fname, summary_buffer_);
+        }
+
+        offsets_ = offsets_buffer_.data();
+        topics_ = topics_buffer_.data();
+        counts_ = counts_buffer_.data();
+        summary_ = summary_buffer_.data();
+        double seconds = watch.ElapsedSeconds();
+        Log::Info("loaded %d word topic tables with %d threads: "
+            "%.2f MB in %.2f s, %.2f MB/s\n", 
+            static_cast<int32_t>(wordtopic_fnames.size()), num_threads,
+            num_bytes / 1024.0 / 1024.0, seconds,
+            num_bytes / 1024.0 / 1024.0 / (seconds > 0 ? seconds : 1e-9));
+#endif
     }
 
-    void LocalModel::LoadSummaryTable(const std::string& model_fname)
+    void CompactModel::SetRows()
     {
-        Row<int64_t> * row = static_cast<Row<int64_t>*>
-            (summary_table_->GetRow(0));
-        std::ifstream model_file(model_fname, std::ios::in);
-        std::string line;
-        if (getline(model_file, line))
-        {
-            std::stringstream ss(line);
-            std::string fea;
-            std::vector<std::string> feas;
-            int32_t topic_id, freq;
-            //skip word id
-            ss >> fea;
-            //add features to row
-            while (ss >> fea)
-            {
-                size_t pos = fea.find_last_of(':');
-                if (pos != std::string::npos)
+        int32_t num_threads = std::max(1, Config::num_io_threads);
+        short_rows_.assign(num_words_, 0);
+        ParallelFor(num_threads, num_threads, [&](int32_t part)
+        {
+            for (int32_t word_id = part; word_id < num_words_; 
+                word_id += num_threads)
+            {
+                bool is_short = true;
+                for (int64_t k = offsets_[word_id]; 
+                    k < offsets_[word_id + 1] && is_short; ++k)
                 {
-                    topic_id = std::stoi(fea.substr(0, pos));
-                    freq = std::stoi(fea.substr(pos + 1));
-                    row->Add(topic_id, freq);
+                    is_short = counts_[k] >= 0 && 
+                        counts_[k] <= std::numeric_limits<uint16_t>::max();
+                }
+                short_rows_[word_id] = is_short;
+            }
+        });
+
+        // dense rows are indexed in their array of counts, sparse rows in
+        // the offsets of their array of counts
+        row_index_.assign(num_words_, -1);
+        int32_t num_dense = 0;
+        int32_t num_short_dense = 0;
+        int64_t num_short = 0;
+        int64_t num_wide = 0;
+        for (int32_t word_id = 0; word_id < num_words_; ++word_id)
+        {
+            int64_t size = offsets_[word_id + 1] - offsets_[word_id];
+            if (size * 2 >= Config::num_topics)
+            {
+                row_index_[word_id] = short_rows_[word_id] ? 
+                    num_short_dense++ : num_dense++;
+            }
+            else if (short_rows_[word_id])
+            {
+                row_index_[word_id] = static_cast<int32_t>(short_offsets_.size());
+                short_offsets_.push_back(num_short);
+                num_short += size;
+            }
+            else
+            {
+                row_index_[word_id] = static_cast<int32_t>(wide_offsets_.size());
+                wide_offsets_.push_back(num_wide);
+                num_wide += size;
+            }
+        }
+        dense_counts_.assign(
+            static_cast<int64_t>(num_dense) * Config::num_topics, 0);
+        short_dense_counts_.assign(
+            static_cast<int64_t>(num_short_dense) * Config::num_topics, 0);
+        short_counts_.resize(num_short);
+        wide_counts_.resize(num_wide);
+        ParallelFor(num_threads, num_threads, [&](int32_t part)
+        {
+            for (int32_t word_id = part; word_id < num_words_; 
+                word_id += num_threads)
+            {
+                int64_t begin = offsets_[word_id];
+                int64_t end = offsets_[word_id + 1];
+                int64_t index = row_index_[word_id];
+                if ((end - begin) * 2 >= Config::num_topics)
+                {
+                    int64_t offset = index * Config::num_topics;
+                    for (int64_t k = begin; k < end; ++k)
+                    {
+                        if (short_rows_[word_id])
+                        {
+                            short_dense_counts_[offset + topics_[k]] = 
+                                static_cast<uint16_t>(counts_[k]);
+                        }
+                        else
+                        {
+                            dense_counts_[offset + topics_[k]] = counts_[k];
+                        }
+                    }
+                }
+                else if (short_rows_[word_id])
+                {
+                    std::copy(counts_ + begin, counts_ + end, 
+                        short_counts_.begin() + short_offsets_[index]);
                 }
                 else
                 {
-                    Log::Fatal("bad format of model: %s\n", line.c_str());
+                    std::copy(counts_ + begin, counts_ + end, 
+                        wide_counts_.begin() + wide_offsets_[index]);
                 }
             }
-        }
-        model_file.close();
-    }
-
-    void LocalModel::AddWordTopicRow(
-        integer_t word_id, integer_t topic_id, int32_t delta) 
-    {
-        Log::Fatal("Not implemented yet\n");
+        });
+        // counts are only read from the arrays above from now on
+        std::vector<int32_t>().swap(counts_buffer_);
+        counts_ = nullptr;
+        Log::Info("compact model: %lld dense rows of 16-bit counts, %lld of "
+            "32-bit counts, %lld sparse entries of 16-bit counts, %lld of "
+            "32-bit counts\n", static_cast<int64_t>(num_short_dense),
+            static_cast<int64_t>(num_dense), num_short, num_wide);
     }
 
-    void LocalModel::AddSummaryRow(integer_t topic_id, int64_t delta) 
+    void CompactModel::AddWordTopicRow(
+        integer_t word_id, integer_t topic_id, int32_t delta)
     {
-        Log::Fatal("Not implemented yet\n");
+        Log::Fatal("CompactModel is read-only\n");
     }
 
-    Row<int32_t>& LocalModel::GetWordTopicRow(integer_t word)
+    void CompactModel::AddSummaryRow(integer_t topic_id, int64_t delta)
     {
-        return *(static_cast<Row<int32_t>*>(word_topic_table_->GetRow(word)));
+        Log::Fatal("CompactModel is read-only\n");
     }
 
-    Row<int64_t>& LocalModel::GetSummaryRow()
-    {
-        return *(static_cast<Row<int64_t>*>(summary_table_->GetRow(0)));
-    }
-    
     Row<int32_t>& PSModel::GetWordTopicRow(integer_t word_id)
     {
         return trainer_->GetRow<int32_t>(kWordTopicTable, word_id);
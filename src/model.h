@@ -8,57 +8,191 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "common.h"
+#include "util.h"
 #include <multiverso/meta.h>
 
 namespace multiverso 
 { 
     template<typename T> class Row;
-    class Table;
      
 namespace lightlda
 {
     class Meta;
     class Trainer;
 
-    /*! \brief interface for acceess to model */
-    class ModelBase
+    /*! \brief ModelFile is a read-only view of a mapped binary model file */
+    class ModelFile
     {
     public:
-        virtual ~ModelBase() {}
-        virtual Row<int32_t>& GetWordTopicRow(integer_t word_id) = 0;
-        virtual Row<int64_t>& GetSummaryRow() = 0;
-        virtual void AddWordTopicRow(integer_t word_id, integer_t topic_id, 
-            int32_t delta) = 0;
-        virtual void AddSummaryRow(integer_t topic_id, int64_t delta) = 0;
+        ModelFile();
+        /*! 
+         * \brief Maps a model file and checks its header and size, the rows
+         *  are checked by the reader as it scans them
+         * \return false if the file does not exist, fatal if it is invalid
+         */
+        bool Open(const std::string& file_name);
+        int32_t num_words() const;
+        int32_t num_topics() const;
+        int64_t nnz() const;
+        /*! \brief Gets the number of entries of a word, 0 if out of range */
+        int32_t RowSize(integer_t word) const;
+        /*! \brief Gets the topics of the entries of a word */
+        const int32_t* RowTopics(integer_t word) const;
+        /*! \brief Gets the counts of the entries of a word */
+        const int32_t* RowCounts(integer_t word) const;
+        /*! \brief Gets the summary row, indexed by topic */
+        const int64_t* summary() const;
+        /*! \brief Gets the row offsets, int64 * (num_words + 1) */
+        const int64_t* offsets() const;
+    private:
+        MappedFile file_;
+        ModelFileHeader header_;
+        const int64_t* offsets_;
+        const int32_t* topics_;
+        const int32_t* counts_;
+        const int64_t* summary_;
+
+        ModelFile(const ModelFile&) = delete;
+        void operator=(const ModelFile&) = delete;
+    };
+
+    /*!
+     * \brief CompactWordTopicRow is a read-only view of a row of CompactModel.
+     *  A sparse row is the sorted topics and the counts of its entries, a
+     *  dense row is the counts of all topics. Counts are 32-bit, or 16-bit
+     *  for rows whose counts fit
+     */
+    class CompactWordTopicRow
+    {
+    public:
+        /*! \brief iterates the non-zero entries in ascending topic order */
+        class iterator
+        {
+        public:
+            iterator(const CompactWordTopicRow& row);
+            bool HasNext() const;
+            void Next();
+            integer_t Key() const;
+            int32_t Value() const;
+        private:
+            void SkipZero();
+            const CompactWordTopicRow& row_;
+            int32_t index_;
+        };
+
+        /*! \brief One of counts and short_counts is nullptr */
+        CompactWordTopicRow(const int32_t* topics, const int32_t* counts, 
+            const uint16_t* short_counts, int32_t size, int32_t nonzero_size);
+        /*! \brief Gets the count of topic, by binary search in sparse rows */
+        int32_t At(integer_t topic) const;
+        int32_t NonzeroSize() const;
+        iterator Iterator() const;
+    private:
+        /*! \brief Gets the count of the index-th entry */
+        int32_t Count(int32_t index) const;
+        /*! \brief rows up to this size are searched linearly */
+        static const int32_t kLinearSearchSize = 16;
+        /*! \brief nullptr for a dense row */
+        const int32_t* topics_;
+        const int32_t* counts_;
+        const uint16_t* short_counts_;
+        /*! \brief number of entries, num_topics for a dense row */
+        int32_t size_;
+        int32_t nonzero_size_;
+    };
+
+    /*! \brief CompactSummaryRow is a read-only view of the summary row */
+    class CompactSummaryRow
+    {
+    public:
+        explicit CompactSummaryRow(const int64_t* counts) : counts_(counts) {}
+        int64_t At(integer_t topic) const { return counts_[topic]; }
+    private:
+        const int64_t* counts_;
     };
 
-    /*! \brief model based on local buffer */
-    class LocalModel : public ModelBase
+    /*!
+     * \brief CompactModel is the read-only model for inference. Rows are
+     *  stored in CSR layout instead of the hash rows of multiverso tables,
+     *  the topics of model.bin are used in place. Rows with at least half of
+     *  the topics non-zero are expanded to dense arrays, so that At is a 
+     *  plain load for the frequent words. The counts of a row are copied to
+     *  16-bit arrays if they are all in [0, 65535], which holds for most of
+     *  the rows, and to 32-bit arrays otherwise.
+     *  It provides the access functions of ModelBase, with views instead of
+     *  rows, so the sampler and the alias table are instantiated for it
+     */
+    class CompactModel
     {
     public:
-        explicit LocalModel(Meta * meta);
+        explicit CompactModel(Meta* meta);
+        /*! \brief Loads model.bin from input_dir, or the text model files */
         void Init();
 
-        Row<int32_t>& GetWordTopicRow(integer_t word_id) override;
-        Row<int64_t>& GetSummaryRow() override;
+        CompactWordTopicRow GetWordTopicRow(integer_t word_id) const;
+        CompactSummaryRow GetSummaryRow() const;
+        /*! \brief Fatal, the model is read-only */
         void AddWordTopicRow(integer_t word_id, integer_t topic_id, 
-            int32_t delta) override;
-        void AddSummaryRow(integer_t topic_id, int64_t delta) override;
-
+            int32_t delta);
+        /*! \brief Fatal, the model is read-only */
+        void AddSummaryRow(integer_t topic_id, int64_t delta);
     private:
-        void CreateTable();
-        void LoadTable();
-        void LoadWordTopicTable(const std::string& model_fname);
-        void LoadSummaryTable(const std::string& model_fname);
+        /*! \brief Loads the text model files of the servers into owned rows */
+        void LoadTextTable();
+        /*!
+         * \brief Chooses the dense or sparse layout and the count width of
+         *  the rows and copies their counts, after the rows are set
+         */
+        void SetRows();
 
-        std::unique_ptr<Table> word_topic_table_;
-        std::unique_ptr<Table> summary_table_;
         Meta* meta_;
+        int32_t num_words_;
+        /*! 
+         * \brief rows in CSR layout, in model_file_ or in the vectors below,
+         *  counts_ is only read by SetRows
+         */
+        const int64_t* offsets_;
+        const int32_t* topics_;
+        const int32_t* counts_;
+        const int64_t* summary_;
+        ModelFile model_file_;
+        std::vector<int64_t> offsets_buffer_;
+        std::vector<int32_t> topics_buffer_;
+        std::vector<int32_t> counts_buffer_;
+        std::vector<int64_t> summary_buffer_;
+        /*! \brief 1 if the counts of the row are 16-bit */
+        std::vector<uint8_t> short_rows_;
+        /*!
+         * \brief index of a dense row in dense_counts_ or short_dense_counts_,
+         *  of a sparse row in short_offsets_ or wide_offsets_
+         */
+        std::vector<int32_t> row_index_;
+        std::vector<int32_t> dense_counts_;
+        std::vector<uint16_t> short_dense_counts_;
+        /*! \brief 16-bit counts of sparse rows, from short_offsets_ */
+        std::vector<uint16_t> short_counts_;
+        std::vector<int64_t> short_offsets_;
+        /*! \brief 32-bit counts of sparse rows, from wide_offsets_ */
+        std::vector<int32_t> wide_counts_;
+        std::vector<int64_t> wide_offsets_;
+
+        CompactModel(const CompactModel&) = delete;
+        void operator=(const CompactModel&) = delete;
+    };
 
-        LocalModel(const LocalModel&) = delete;
-        void operator=(const LocalModel&) = delete;
+    /*! \brief interface for acceess to model */
+    class ModelBase
+    {
+    public:
+        virtual ~ModelBase() {}
+        virtual Row<int32_t>& GetWordTopicRow(integer_t word_id) = 0;
+        virtual Row<int64_t>& GetSummaryRow() = 0;
+        virtual void AddWordTopicRow(integer_t word_id, integer_t topic_id, 
+            int32_t delta) = 0;
+        virtual void AddSummaryRow(integer_t topic_id, int64_t delta) = 0;
     };
 
     /*! \brief model based on parameter server */
@@ -80,6 +214,125 @@ namespace lightlda
         void operator=(const PSModel&) = delete;
     };
 
+    // -- inline functions definition area --------------------------------- //
+    inline int32_t ModelFile::num_words() const { return header_.num_words; }
+    inline int32_t ModelFile::num_topics() const { return header_.num_topics; }
+    inline int64_t ModelFile::nnz() const { return header_.nnz; }
+    inline int32_t ModelFile::RowSize(integer_t word) const
+    {
+        if (word < 0 || word >= header_.num_words) return 0;
+        return static_cast<int32_t>(offsets_[word + 1] - offsets_[word]);
+    }
+    inline const int32_t* ModelFile::RowTopics(integer_t word) const
+    {
+        return topics_ + offsets_[word];
+    }
+    inline const int32_t* ModelFile::RowCounts(integer_t word) const
+    {
+        return counts_ + offsets_[word];
+    }
+    inline const int64_t* ModelFile::summary() const { return summary_; }
+    inline const int64_t* ModelFile::offsets() const { return offsets_; }
+
+    inline CompactWordTopicRow::CompactWordTopicRow(const int32_t* topics, 
+        const int32_t* counts, const uint16_t* short_counts, int32_t size, 
+        int32_t nonzero_size) 
+        : topics_(topics), counts_(counts), short_counts_(short_counts),
+        size_(size), nonzero_size_(nonzero_size) {}
+    inline int32_t CompactWordTopicRow::Count(int32_t index) const
+    {
+        return counts_ != nullptr ? counts_[index] : short_counts_[index];
+    }
+    inline int32_t CompactWordTopicRow::At(integer_t topic) const
+    {
+        if (topics_ == nullptr) return Count(topic);
+        if (size_ <= kLinearSearchSize)
+        {
+            for (int32_t i = 0; i < size_ && topics_[i] <= topic; ++i)
+            {
+                if (topics_[i] == topic) return Count(i);
+            }
+            return 0;
+        }
+        int32_t begin = 0, end = size_;
+        while (begin < end)
+        {
+            int32_t mid = (begin + end) / 2;
+            if (topics_[mid] < topic) begin = mid + 1;
+            else end = mid;
+        }
+        return (begin < size_ && topics_[begin] == topic) ? Count(begin) : 0;
+    }
+    inline int32_t CompactWordTopicRow::NonzeroSize() const 
+    { 
+        return nonzero_size_; 
+    }
+    inline CompactWordTopicRow::iterator CompactWordTopicRow::Iterator() const
+    {
+        return iterator(*this);
+    }
+
+    inline CompactWordTopicRow::iterator::iterator(const CompactWordTopicRow& row)
+        : row_(row), index_(0)
+    {
+        SkipZero();
+    }
+    inline bool CompactWordTopicRow::iterator::HasNext() const
+    {
+        return index_ < row_.size_;
+    }
+    inline void CompactWordTopicRow::iterator::Next()
+    {
+        ++index_;
+        SkipZero();
+    }
+    inline integer_t CompactWordTopicRow::iterator::Key() const
+    {
+        return row_.topics_ == nullptr ? index_ : row_.topics_[index_];
+    }
+    inline int32_t CompactWordTopicRow::iterator::Value() const
+    {
+        return row_.Count(index_);
+    }
+    inline void CompactWordTopicRow::iterator::SkipZero()
+    {
+        while (index_ < row_.size_ && row_.Count(index_) == 0) ++index_;
+    }
+
+    inline CompactWordTopicRow CompactModel::GetWordTopicRow(
+        integer_t word_id) const
+    {
+        static const int32_t kNoEntry = 0;
+        if (word_id < 0 || word_id >= num_words_)
+        {
+            return CompactWordTopicRow(&kNoEntry, &kNoEntry, nullptr, 0, 0);
+        }
+        int32_t size = static_cast<int32_t>(
+            offsets_[word_id + 1] - offsets_[word_id]);
+        int64_t index = row_index_[word_id];
+        bool is_short = short_rows_[word_id] != 0;
+        if (size * 2 >= Config::num_topics)
+        {
+            int64_t offset = index * Config::num_topics;
+            return is_short ? 
+                CompactWordTopicRow(nullptr, nullptr, 
+                    short_dense_counts_.data() + offset, Config::num_topics, size) :
+                CompactWordTopicRow(nullptr, dense_counts_.data() + offset, 
+                    nullptr, Config::num_topics, size);
+        }
+        const int32_t* topics = topics_ + offsets_[word_id];
+        return is_short ?
+            CompactWordTopicRow(topics, nullptr, 
+                short_counts_.data() + short_offsets_[index], size, size) :
+            CompactWordTopicRow(topics, wide_counts_.data() + 
+                wide_offsets_[index], nullptr, size, size);
+    }
+    inline CompactSummaryRow CompactModel::GetSummaryRow() const
+    {
+        return CompactSummaryRow(summary_);
+    }
+    // -- inline functions definition area --------------------------------- //
+
 } // namespace lightlda
 } // namespace multiverso
 
@@ -0,0 +1,301 @@
+#include "model_export.h"
+
+#include "common.h"
+#include "meta.h"
+#include "model.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+
+#include <multiverso/log.h>
+#include <multiverso/multiverso.h>
+#include <multiverso/stop_watch.h>
+
+namespace multiverso { namespace lightlda
+{
+    ModelExport::ModelExport(const std::string& path, const Meta* meta)
+        : path_(path), iteration_(0), active_(false), num_bytes_(0),
+        busy_(false), stop_(false)
+    {
+        if (!MakeDirectory(path_))
+        {
+            Log::Fatal("Failed to create model export dir %s\n", path_.c_str());
+        }
+        export_block_.assign(Config::num_vocabs, -1);
+        for (int32_t block = Config::num_blocks - 1; block >= 0; --block)
+        {
+            const LocalVocab& vocab = meta->local_vocab(block);
+            for (int32_t slice = 0; slice < vocab.num_slice(); ++slice)
+            {
+                for (const int32_t* p = vocab.begin(slice);
+                    p != vocab.end(slice); ++p)
+                {
+                    export_block_[*p] = block;
+                }
+            }
+        }
+        writer_thread_ = std::thread(&ModelExport::WriterMain, this);
+    }
+
+    ModelExport::~ModelExport()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        writer_thread_.join();
+    }
+
+    void ModelExport::Begin(int32_t iteration)
+    {
+        Wait();
+        iteration_ = iteration;
+        std::string path = ExportPath(iteration);
+        if (!MakeDirectory(path))
+        {
+            Log::Fatal("Failed to create model export dir %s\n", path.c_str());
+        }
+        std::string file_name = Config::export_text ?
+            path + "/server_" + std::to_string(Multiverso::ProcessRank())
+            + "_table_" + std::to_string(kWordTopicTable) + ".model.temp" :
+            path + "/" + kModelFileName + ".rows";
+        rows_file_.open(file_name, std::ios::out | std::ios::binary |
+            std::ios::trunc);
+        if (!rows_file_.good())
+        {
+            Log::Fatal("Failed to open file %s\n", file_name.c_str());
+        }
+        num_bytes_ = 0;
+        summary_.assign(Config::num_topics, 0);
+        active_ = true;
+        Log::Info("Rank = %d, begin model export of iteration %d to %s\n",
+            Multiverso::ProcessRank(), iteration, path.c_str());
+    }
+
+    void ModelExport::AddRows(const ExportRows& rows)
+    {
+        std::shared_ptr<std::string> buffer(new std::string());
+        int64_t k = 0;
+        if (Config::export_text)
+        {
+            // same as the model files of servers
+            for (size_t i = 0; i < rows.words.size(); ++i)
+            {
+                buffer->append(std::to_string(rows.words[i]));
+                for (int32_t j = 0; j < rows.sizes[i]; ++j, ++k)
+                {
+                    buffer->push_back(' ');
+                    buffer->append(std::to_string(rows.topics[k]));
+                    buffer->push_back(':');
+                    buffer->append(std::to_string(rows.counts[k]));
+                }
+                buffer->push_back('\n');
+            }
+        }
+        else
+        {
+            // word, size, topics and counts of each row
+            auto append = [&buffer](const int32_t* data, int64_t size)
+            {
+                buffer->append(reinterpret_cast<const char*>(data),
+                    sizeof(int32_t) * size);
+            };
+            for (size_t i = 0; i < rows.words.size(); ++i)
+            {
+                append(&rows.words[i], 1);
+                append(&rows.sizes[i], 1);
+                append(rows.topics.data() + k, rows.sizes[i]);
+                append(rows.counts.data() + k, rows.sizes[i]);
+                k += rows.sizes[i];
+            }
+        }
+        Submit([this, buffer]()
+        {
+            rows_file_.write(buffer->data(), buffer->size());
+            num_bytes_ += buffer->size();
+        });
+    }
+
+    void ModelExport::SetSummary(const std::vector<int64_t>& summary)
+    {
+        summary_ = summary;
+    }
+
+    void ModelExport::Commit()
+    {
+        active_ = false;
+        int32_t iteration = iteration_;
+        std::vector<int64_t> summary = summary_;
+        Submit([this, iteration, summary]()
+        {
+            StopWatch watch; watch.Start();
+            rows_file_.close();
+            if (!rows_file_.good())
+            {
+                Log::Fatal("Failed to write model export of iteration %d\n",
+                    iteration);
+            }
+            std::string prefix = ExportPath(iteration) + "/server_" +
+                std::to_string(Multiverso::ProcessRank()) + "_table_";
+            if (Config::export_text)
+            {
+                std::string file_name = prefix +
+                    std::to_string(kWordTopicTable) + ".model";
+                AtomicMoveFile(file_name + ".temp", file_name);
+                WriteSummaryFile(prefix + std::to_string(kSummaryRow)
+                    + ".model", summary);
+            }
+            else
+            {
+                std::string file_name = ExportPath(iteration) + "/"
+                    + kModelFileName;
+                WriteModelFile(file_name + ".rows", file_name, summary);
+            }
+            Log::Info("Rank = %d, model of iteration %d exported, %.2f MB "
+                "of rows, commit time used: %.2f s\n",
+                Multiverso::ProcessRank(), iteration,
+                num_bytes_ / 1024.0 / 1024.0, watch.ElapsedSeconds());
+        });
+    }
+
+    void ModelExport::WriterMain()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+                if (tasks_.empty())
+                {
+                    break;
+                }
+                task = tasks_.front();
+                tasks_.pop();
+                busy_ = true;
+            }
+            task();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                busy_ = false;
+            }
+            cv_.notify_all();
+        }
+    }
+
+    void ModelExport::Submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push(task);
+        }
+        cv_.notify_all();
+    }
+
+    void ModelExport::Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return tasks_.empty() && !busy_; });
+    }
+
+    void ModelExport::WriteModelFile(const std::string& temp_file,
+        const std::string& file_name, const std::vector<int64_t>& summary)
+    {
+        std::ifstream rows_file(temp_file, std::ios::in | std::ios::binary);
+        if (!rows_file.good())
+        {
+            Log::Fatal("Failed to open file %s\n", temp_file.c_str());
+        }
+        rows_file.seekg(0, std::ios::end);
+        std::vector<int32_t> rows(rows_file.tellg() / sizeof(int32_t));
+        rows_file.seekg(0, std::ios::beg);
+        rows_file.read(reinterpret_cast<char*>(rows.data()),
+            sizeof(int32_t) * rows.size());
+        rows_file.close();
+
+        // Rows come in the order of slices, a word is in one row only
+        std::vector<int64_t> offsets(Config::num_vocabs + 1, 0);
+        for (size_t p = 0; p < rows.size(); p += 2 + 2 * rows[p + 1])
+        {
+            offsets[rows[p] + 1] += rows[p + 1];
+        }
+        for (int32_t word = 0; word < Config::num_vocabs; ++word)
+        {
+            offsets[word + 1] += offsets[word];
+        }
+        int64_t nnz = offsets[Config::num_vocabs];
+        std::vector<int32_t> topics(nnz);
+        std::vector<int32_t> counts(nnz);
+        for (size_t p = 0; p < rows.size(); p += 2 + 2 * rows[p + 1])
+        {
+            int32_t size = rows[p + 1];
+            std::copy(rows.begin() + p + 2, rows.begin() + p + 2 + size,
+                topics.begin() + offsets[rows[p]]);
+            std::copy(rows.begin() + p + 2 + size,
+                rows.begin() + p + 2 + 2 * size,
+                counts.begin() + offsets[rows[p]]);
+        }
+        std::vector<int32_t>().swap(rows);
+
+        ModelFileHeader header;
+        header.magic = kModelMagic;
+        header.version = kFormatVersion;
+        header.byte_order = kByteOrderMark;
+        header.num_words = Config::num_vocabs;
+        header.num_topics = Config::num_topics;
+        header.nnz = nnz;
+        std::string model_temp = file_name + ".temp";
+        std::ofstream model_file(model_temp, std::ios::out | std::ios::binary);
+        if (!model_file.good())
+        {
+            Log::Fatal("Failed to open file %s\n", model_temp.c_str());
+        }
+        model_file.write(reinterpret_cast<char*>(&header), sizeof(header));
+        model_file.write(reinterpret_cast<char*>(offsets.data()),
+            sizeof(int64_t) * offsets.size());
+        model_file.write(reinterpret_cast<char*>(topics.data()),
+            sizeof(int32_t) * nnz);
+        model_file.write(reinterpret_cast<char*>(counts.data()),
+            sizeof(int32_t) * nnz);
+        model_file.write(reinterpret_cast<const char*>(summary.data()),
+            sizeof(int64_t) * summary.size());
+        model_file.close();
+        if (!model_file.good())
+        {
+            Log::Fatal("Failed to write file %s\n", model_temp.c_str());
+        }
+        AtomicMoveFile(model_temp, file_name);
+        remove(temp_file.c_str());
+    }
+
+    void ModelExport::WriteSummaryFile(const std::string& file_name,
+        const std::vector<int64_t>& summary)
+    {
+        std::string temp_file = file_name + ".temp";
+        std::ofstream summary_file(temp_file, std::ios::out | std::ios::binary);
+        if (!summary_file.good())
+        {
+            Log::Fatal("Failed to open file %s\n", temp_file.c_str());
+        }
+        summary_file << 0;
+        for (int32_t topic = 0; topic < Config::num_topics; ++topic)
+        {
+            if (summary[topic] != 0)
+            {
+                summary_file << " " << topic << ":" << summary[topic];
+            }
+        }
+        summary_file << "\n";
+        summary_file.close();
+        AtomicMoveFile(temp_file, file_name);
+    }
+
+    std::string ModelExport::ExportPath(int32_t iteration) const
+    {
+        return path_ + "/iteration." + std::to_string(iteration);
+    }
+} // namespace lightlda
+} // namespace multiverso
@@ -0,0 +1,115 @@
+/*!
+ * \file model_export.h
+ * \brief Defines export of the trained model for inference
+ */
+
+#ifndef LIGHTLDA_MODEL_EXPORT_H_
+#define LIGHTLDA_MODEL_EXPORT_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace multiverso { namespace lightlda
+{
+    class Meta;
+
+    /*! \brief rows copied by a trainer, with entries in ascending topics */
+    struct ExportRows
+    {
+        std::vector<int32_t> words;
+        std::vector<int32_t> sizes;
+        std::vector<int32_t> topics;
+        std::vector<int32_t> counts;
+    };
+
+    /*!
+     * \brief ModelExport writes the word-topic rows and the summary row of
+     *  an iteration, as trainers hold them for their slices, to the files
+     *  inference loads: model.bin, or the text files server_<rank>_table_0
+     *  and server_<rank>_table_1.model with -export_text.
+     *
+     *  Trainers serialize their rows on their own threads, a background
+     *  thread appends them to a temporary file, so training goes on during
+     *  the export. On commit the background thread moves the files to
+     *  <path>/iteration.<n>, for model.bin after sorting the rows by word.
+     *  A word is exported in the first block containing it. Export needs
+     *  the words of all data in one process, it is fatal with more than one.
+     */
+    class ModelExport
+    {
+    public:
+        ModelExport(const std::string& path, const Meta* meta);
+        ~ModelExport();
+        /*!
+         * \brief Starts an export, after the previous one is written
+         * \param iteration number of iterations trained when exported
+         */
+        void Begin(int32_t iteration);
+        /*! \brief Whether an export is in progress */
+        bool active() const;
+        /*! \brief Whether the row of word is exported with block */
+        bool IsExported(int32_t word, int32_t block) const;
+        /*! \brief Serializes rows on the calling thread and queues them */
+        void AddRows(const ExportRows& rows);
+        /*! \brief Sets the summary row, the last one set is exported */
+        void SetSummary(const std::vector<int64_t>& summary);
+        /*! \brief Commits the current export when all rows are added */
+        void Commit();
+    private:
+        /*! \brief Background thread entrance function */
+        void WriterMain();
+        /*! \brief Pushes a task to the background thread */
+        void Submit(std::function<void()> task);
+        /*! \brief Waits until the background thread is idle */
+        void Wait();
+        /*! \brief Writes model.bin from the rows in temp_file */
+        void WriteModelFile(const std::string& temp_file,
+            const std::string& file_name, const std::vector<int64_t>& summary);
+        /*! \brief Writes the text summary table file */
+        void WriteSummaryFile(const std::string& file_name,
+            const std::vector<int64_t>& summary);
+        std::string ExportPath(int32_t iteration) const;
+
+        /*! \brief path of export directory */
+        std::string path_;
+        /*! \brief first block containing each word, -1 if none */
+        std::vector<int32_t> export_block_;
+        /*! \brief iteration of the export in progress */
+        int32_t iteration_;
+        bool active_;
+        std::vector<int64_t> summary_;
+        /*! \brief rows of the export in progress, written by the background thread */
+        std::ofstream rows_file_;
+        int64_t num_bytes_;
+
+        std::queue<std::function<void()>> tasks_;
+        bool busy_;
+        bool stop_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::thread writer_thread_;
+
+        // No copying allowed
+        ModelExport(const ModelExport&);
+        void operator=(const ModelExport&);
+    };
+
+    // -- inline functions definition area --------------------------------- //
+    inline bool ModelExport::active() const { return active_; }
+    inline bool ModelExport::IsExported(int32_t word, int32_t block) const
+    {
+        return export_block_[word] == block;
+    }
+    // -- inline functions definition area --------------------------------- //
+
+} // namespace lightlda
+} // namespace multiverso
+
+#endif // LIGHTLDA_MODEL_EXPORT_H_
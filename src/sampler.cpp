@@ -30,6 +30,19 @@ namespace multiverso { namespace lightlda
 
     int32_t LightDocSampler::SampleOneDoc(Document* doc, int32_t slice,
         int32_t lastword, ModelBase* model, AliasTable* alias)
+    {
+        return SampleOneDocImpl(doc, slice, lastword, model, alias);
+    }
+
+    int32_t LightDocSampler::SampleOneDoc(Document* doc, int32_t slice,
+        int32_t lastword, CompactModel* model, AliasTable* alias)
+    {
+        return SampleOneDocImpl(doc, slice, lastword, model, alias);
+    }
+
+    template <typename Model>
+    int32_t LightDocSampler::SampleOneDocImpl(Document* doc, int32_t slice,
+        int32_t lastword, Model* model, AliasTable* alias)
     {
         DocInit(doc);
         int32_t num_tokens = 0;
@@ -66,9 +79,10 @@ namespace multiverso { namespace lightlda
         doc->GetDocTopicVector(*doc_topic_counter_);
     }
 
+    template <typename Model>
     int32_t LightDocSampler::Sample(Document* doc,
         int32_t word, int32_t old_topic, int32_t s,
-        ModelBase* model, AliasTable* alias)
+        Model* model, AliasTable* alias)
     {
         int32_t t, w_t_cnt, w_s_cnt;
         int64_t n_t, n_s;
@@ -79,8 +93,9 @@ namespace multiverso { namespace lightlda
         double rejection, pi;
         int32_t m;
 
-        Row<int32_t>& word_topic_row = model->GetWordTopicRow(word);
-        Row<int64_t>& summary_row = model->GetSummaryRow();
+        // a Row of ModelBase, or a view of CompactModel
+        auto&& word_topic_row = model->GetWordTopicRow(word);
+        auto&& summary_row = model->GetSummaryRow();
 
         for (int32_t i = 0; i < mh_steps_; ++i)
         {
@@ -213,17 +228,18 @@ namespace multiverso { namespace lightlda
         return s;
     }
 
+    template <typename Model>
     int32_t LightDocSampler::ApproxSample(Document* doc,
         int32_t word, int32_t old_topic, int32_t s,
-        ModelBase* model, AliasTable* alias)
+        Model* model, AliasTable* alias)
     {
         float n_tw_beta, n_sw_beta, n_t_beta_sum, n_s_beta_sum;
         float nominator, denominator;
         double rejection, pi;
         int32_t m, t;
         
-        Row<int32_t>& word_topic_row = model->GetWordTopicRow(word);
-        Row<int64_t>& summary_row = model->GetSummaryRow();
+        auto&& word_topic_row = model->GetWordTopicRow(word);
+        auto&& summary_row = model->GetSummaryRow();
 
         for (int32_t i = 0; i < mh_steps_; ++i)
         {
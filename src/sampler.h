@@ -18,6 +18,7 @@ namespace multiverso
 namespace multiverso { namespace lightlda
 {
     class AliasTable;
+    class CompactModel;
     class Document;
     class ModelBase;
     
@@ -38,12 +39,21 @@ namespace multiverso { namespace lightlda
          */
         int32_t SampleOneDoc(Document* doc, int32_t slice, int32_t lastword,
             ModelBase* model, AliasTable* alias);
+        /*! \brief Sample one document with the read-only model of inference */
+        int32_t SampleOneDoc(Document* doc, int32_t slice, int32_t lastword,
+            CompactModel* model, AliasTable* alias);
         /*!
          * \brief Get doc-topic-counter, for reusing this container
          * \return reference to light hash map
          */
         Row<int32_t>& doc_topic_counter() { return *doc_topic_counter_; }
+        /*! \brief Get the random number generator, for checkpoint */
+        xorshift_rng& rng() { return rng_; }
     private:
+        /*! \brief Implements SampleOneDoc for ModelBase and CompactModel */
+        template <typename Model>
+        int32_t SampleOneDocImpl(Document* doc, int32_t slice, int32_t lastword,
+            Model* model, AliasTable* alias);
         /*!
          * \brief Init document before sampling
          * \param doc pointer to document
@@ -58,8 +68,9 @@ namespace multiverso { namespace lightlda
          * \param model access
          * \param alias for alias table access
          */
+        template <typename Model>
         int32_t Sample(Document* doc, int32_t word, int32_t state, 
-            int32_t old_topic, ModelBase* model, AliasTable* alias);
+            int32_t old_topic, Model* model, AliasTable* alias);
 
         /*! 
          * \brief Sample the latent topic assignment for a token. This function
@@ -68,8 +79,9 @@ namespace multiverso { namespace lightlda
          *  with faster speed.
          * \param same with Sample
          */
+        template <typename Model>
         int32_t ApproxSample(Document* doc, int32_t word, int32_t state, 
-            int32_t old_topic, ModelBase* model, AliasTable* alias);
+            int32_t old_topic, Model* model, AliasTable* alias);
     private:
         // lda hyper-parameter
         float alpha_;
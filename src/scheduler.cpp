@@ -0,0 +1,119 @@
+#include "scheduler.h"
+
+#include "data_block.h"
+#include "document.h"
+
+#include <algorithm>
+
+#include <multiverso/log.h>
+#include <multiverso/multiverso.h>
+
+namespace multiverso { namespace lightlda
+{
+    namespace
+    {
+        /*! \brief number of chunks per thread, more chunks steal finer */
+        const int32_t kChunksPerThread = 16;
+    }
+
+    DocScheduler::DocScheduler(int32_t num_threads)
+        : num_threads_(num_threads), 
+        next_chunk_(new std::atomic<int32_t>[num_threads]),
+        busy_seconds_(num_threads, 0.0)
+    {
+        range_begin_.assign(num_threads_ + 1, 0);
+        Reset();
+    }
+
+    void DocScheduler::Init(const DataBlock& data)
+    {
+        // Cost of a document is its number of tokens, plus one for the
+        // per document overhead such as building the doc-topic counter
+        int64_t total_cost = data.token_num() + data.Size();
+        int64_t chunk_cost = std::max<int64_t>(1, 
+            total_cost / (num_threads_ * kChunksPerThread));
+
+        chunk_begin_.clear();
+        std::vector<int64_t> chunk_prefix_cost;
+        int64_t cost = 0;
+        int64_t last_cost = 0;
+        for (int32_t i = 0; i < data.Size(); ++i)
+        {
+            if (i == 0 || cost - last_cost >= chunk_cost)
+            {
+                chunk_begin_.push_back(i);
+                chunk_prefix_cost.push_back(cost);
+                last_cost = cost;
+            }
+            cost += data.GetOneDoc(i).Size() + 1;
+        }
+        int32_t num_chunks = static_cast<int32_t>(chunk_begin_.size());
+        chunk_begin_.push_back(static_cast<int32_t>(data.Size()));
+
+        // Thread t owns the chunks starting in [t, t + 1) * total / threads
+        int32_t chunk = 0;
+        for (int32_t t = 0; t < num_threads_; ++t)
+        {
+            range_begin_[t] = chunk;
+            int64_t range_end_cost = total_cost * (t + 1) / num_threads_;
+            while (chunk < num_chunks && 
+                chunk_prefix_cost[chunk] < range_end_cost)
+            {
+                ++chunk;
+            }
+        }
+        range_begin_[num_threads_] = num_chunks;
+        Reset();
+    }
+
+    void DocScheduler::Reset()
+    {
+        for (int32_t t = 0; t < num_threads_; ++t)
+        {
+            next_chunk_[t] = range_begin_[t];
+        }
+    }
+
+    bool DocScheduler::Next(int32_t id, int32_t* begin, int32_t* end)
+    {
+        // Own range first, then steal from the following ranges
+        for (int32_t k = 0; k < num_threads_; ++k)
+        {
+            int32_t range = (id + k) % num_threads_;
+            if (next_chunk_[range] >= range_begin_[range + 1])
+            {
+                continue;
+            }
+            int32_t chunk = next_chunk_[range]++;
+            if (chunk < range_begin_[range + 1])
+            {
+                *begin = chunk_begin_[chunk];
+                *end = chunk_begin_[chunk + 1];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void DocScheduler::Record(int32_t id, double busy_seconds)
+    {
+        busy_seconds_[id] = busy_seconds;
+    }
+
+    void DocScheduler::Report() const
+    {
+        double max_busy = 0, min_busy = 1e30, sum_busy = 0;
+        for (int32_t t = 0; t < num_threads_; ++t)
+        {
+            max_busy = std::max(max_busy, busy_seconds_[t]);
+            min_busy = std::min(min_busy, busy_seconds_[t]);
+            sum_busy += busy_seconds_[t];
+        }
+        double max_idle = max_busy - min_busy;
+        double sum_idle = max_busy * num_threads_ - sum_busy;
+        Log::Info("Rank = %d, Thread busy time: max %.3f s, min %.3f s, avg %.3f s; idle time: max %.3f s, avg %.3f s\n",
+            Multiverso::ProcessRank(), max_busy, min_busy, 
+            sum_busy / num_threads_, max_idle, sum_idle / num_threads_);
+    }
+} // namespace lightlda
+} // namespace multiverso
@@ -0,0 +1,67 @@
+/*!
+ * \file scheduler.h
+ * \brief Defines the document scheduler for sampling threads
+ */
+
+#ifndef LIGHTLDA_SCHEDULER_H_
+#define LIGHTLDA_SCHEDULER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace multiverso { namespace lightlda
+{
+    class DataBlock;
+
+    /*!
+     * \brief DocScheduler hands out the documents of a data block to 
+     *  sampling threads. Documents are grouped into chunks of about the 
+     *  same number of tokens, computed from the document offsets. Each 
+     *  thread owns a contiguous range of chunks with 1 / num_threads of the
+     *  tokens, and steals chunks from the other ranges when its own range
+     *  is exhausted, so long documents do not leave a straggler.
+     */
+    class DocScheduler
+    {
+    public:
+        explicit DocScheduler(int32_t num_threads);
+        /*! \brief Splits a block into chunks, should be called by one thread */
+        void Init(const DataBlock& data);
+        /*! \brief Makes all chunks available again, called by one thread */
+        void Reset();
+        /*!
+         * \brief Gets the next chunk of documents for a thread
+         * \param id thread id
+         * \param begin first document of the chunk
+         * \param end last document of the chunk + 1
+         * \return false if all chunks are taken
+         */
+        bool Next(int32_t id, int32_t* begin, int32_t* end);
+        /*! \brief Records the busy time of a thread in this round */
+        void Record(int32_t id, double busy_seconds);
+        /*! 
+         * \brief Logs the busy and idle time of threads in this round, idle
+         *  time is the time a thread waits for the slowest one at barrier.
+         *  Should be called after all threads recorded
+         */
+        void Report() const;
+    private:
+        int32_t num_threads_;
+        /*! \brief first document of each chunk, with the end as last item */
+        std::vector<int32_t> chunk_begin_;
+        /*! \brief first chunk of each thread range, with the end as last item */
+        std::vector<int32_t> range_begin_;
+        /*! \brief next chunk to take in each thread range */
+        std::unique_ptr<std::atomic<int32_t>[]> next_chunk_;
+        std::vector<double> busy_seconds_;
+
+        // No copying allowed
+        DocScheduler(const DocScheduler&);
+        void operator=(const DocScheduler&);
+    };
+} // namespace lightlda
+} // namespace multiverso
+
+#endif // LIGHTLDA_SCHEDULER_H_
@@ -6,9 +6,13 @@
 #include "document.h"
 #include "eval.h"
 #include "meta.h"
+#include "model_export.h"
 #include "sampler.h"
+#include "scheduler.h"
 #include "model.h"
 
+#include <algorithm>
+
 #include <multiverso/barrier.h>
 #include <multiverso/stop_watch.h>
 #include <multiverso/log.h>
@@ -20,9 +24,10 @@ namespace multiverso { namespace lightlda
     double Trainer::word_llh_ = 0.0;
 
     Trainer::Trainer(AliasTable* alias_table, 
-                Barrier* barrier, Meta* meta) : 
+                Barrier* barrier, Meta* meta, DocScheduler* scheduler,
+                ModelExport* exporter) : 
         alias_(alias_table), barrier_(barrier), meta_(meta),
-        model_(nullptr)
+        scheduler_(scheduler), model_(nullptr), exporter_(exporter)
     {
         sampler_ = new LightDocSampler();
         model_ = new PSModel(this);
@@ -55,8 +60,19 @@ namespace multiverso { namespace lightlda
                 Multiverso::ProcessRank(), lda_data_block->iteration(),
                 lda_data_block->block(), lda_data_block->slice());
         }
-        // Build Alias table
-        if (id == 0) alias_->Init(meta_->alias_index(block, slice));
+        // Build Alias table, with rows laid out by the current model
+        if (id == 0)
+        {
+            alias_->Init(meta_->alias_index(block, slice));
+            alias_->Plan(local_vocab.begin(slice), local_vocab.end(slice),
+                model_);
+        }
+        if (id == 0)
+        {
+            // Documents are the same for all slices of a block
+            if (slice == 0) scheduler_->Init(data);
+            else scheduler_->Reset();
+        }
         barrier_->Wait();
         for (const int32_t* pword = local_vocab.begin(slice) + id;
             pword < local_vocab.end(slice);
@@ -90,36 +106,44 @@ namespace multiverso { namespace lightlda
         }
         int32_t num_token = 0;
         watch.Restart();
-        // Train with lightlda sampler
-        for (int32_t doc_id = id; doc_id < data.Size(); doc_id += trainer_num)
-        {
-            Document* doc = data.GetOneDoc(doc_id);
-            // when iter 0 && slice 0, check all words in one doc belong to the same topic
-            // just one of my experiment, reviewers do not need to care
-            if (iter == 0 && slice == 0) {
-              if (Config::word_init) {
-                for (int32_t word_idx = 0; word_idx < doc->Size(); ++word_idx) {
-                        if (doc->Topic(word_idx) != doc->Word(word_idx)) {
-                    Log::Fatal("word topic id not equals to word id, word id = %d, word topic = %d\n", doc->Word(word_idx), doc->Topic(word_idx));
-                  }
-                }
-              } else {
-                int32_t doc_topic_id = doc->Topic(0);
-                for (int32_t word_idx = 1; word_idx < doc->Size(); ++word_idx) {
-                        if (doc->Topic(word_idx) != doc_topic_id) {
-                    Log::Fatal("word topic id not equals to doc topic id, word id = %d, word topic = %d, doc topic = %d\n", doc->Word(word_idx), doc->Topic(word_idx), doc_topic_id);
+        // Train with lightlda sampler, documents are taken chunk by chunk
+        int32_t doc_begin = 0, doc_end = 0;
+        while (scheduler_->Next(id, &doc_begin, &doc_end))
+        {
+            for (int32_t doc_id = doc_begin; doc_id < doc_end; ++doc_id)
+            {
+                Document doc = data.GetOneDoc(doc_id);
+                // when iter 0 && slice 0, check all words in one doc belong to the same topic
+                // just one of my experiment, reviewers do not need to care
+                if (iter == 0 && slice == 0) {
+                  if (Config::word_init) {
+                    for (int32_t word_idx = 0; word_idx < doc.Size(); ++word_idx) {
+                            if (doc.Topic(word_idx) != doc.Word(word_idx)) {
+                        Log::Fatal("word topic id not equals to word id, word id = %d, word topic = %d\n", doc.Word(word_idx), doc.Topic(word_idx));
+                      }
+                    }
+                  } else {
+                    int32_t doc_topic_id = doc.Topic(0);
+                    for (int32_t word_idx = 1; word_idx < doc.Size(); ++word_idx) {
+                            if (doc.Topic(word_idx) != doc_topic_id) {
+                        Log::Fatal("word topic id not equals to doc topic id, word id = %d, word topic = %d, doc topic = %d\n", doc.Word(word_idx), doc.Topic(word_idx), doc_topic_id);
+                      }
+                    }
                   }
                 }
-              }
+                num_token += sampler_->SampleOneDoc(&doc, slice, lastword, model_, alias_);
             }
-            num_token += sampler_->SampleOneDoc(doc, slice, lastword, model_, alias_);
         }
+        double busy_seconds = watch.ElapsedSeconds();
+        scheduler_->Record(id, busy_seconds);
+        barrier_->Wait();
         if (TrainerId() == 0)
         {
             Log::Info("Rank = %d, Training Time used: %.2f s \n", 
                 Multiverso::ProcessRank(), watch.ElapsedSeconds());
             Log::Info("Rank = %d, sampling throughput: %.6f (tokens/thread/sec) \n", 
-                Multiverso::ProcessRank(), double(num_token) / watch.ElapsedSeconds());
+                Multiverso::ProcessRank(), double(num_token) / busy_seconds);
+            scheduler_->Report();
         }
         watch.Restart();
         // Evaluate loss function
@@ -132,7 +156,10 @@ namespace multiverso { namespace lightlda
                 Log::Info("Rank = %d, Evaluation Time used: %.2f s \n",
                     Multiverso::ProcessRank(), watch.ElapsedSeconds());
         }
-        // if (iter != 0 && iter % 50 == 0) Dump(iter, lda_data_block);
+        if (exporter_ != nullptr && exporter_->active())
+        {
+            Export(lda_data_block);
+        }
 
         // Clear the thread information in alias table
         if (iter == Config::num_iterations - 1) alias_->Clear();
@@ -151,7 +178,8 @@ namespace multiverso { namespace lightlda
         for (int32_t doc_id = TrainerId(); doc_id < data.Size() && slice == 0;
             doc_id += TrainerCount())
         {
-            thread_doc += Eval::ComputeOneDocLLH(data.GetOneDoc(doc_id),
+            Document doc = data.GetOneDoc(doc_id);
+            thread_doc += Eval::ComputeOneDocLLH(&doc,
                 sampler_->doc_topic_counter());
         }
         {
@@ -191,35 +219,59 @@ namespace multiverso { namespace lightlda
         barrier_->Wait();
     }
 
-    void Trainer::Dump(int32_t iter, LDADataBlock* lda_data_block)
+    void Trainer::Export(LDADataBlock* lda_data_block)
     {
         DataBlock& data = lda_data_block->data();
+        int32_t block = lda_data_block->block();
         int32_t slice = lda_data_block->slice();
         const LocalVocab& local_vocab = data.meta();
 
-        std::string out = "model." + std::to_string(iter) + "." 
-            + std::to_string(slice) + "." + std::to_string(TrainerId());
-        std::ofstream fout(out);
-
+        ExportRows rows;
+        std::vector<std::pair<int32_t, int32_t>> entries;
         for (const int32_t* p = local_vocab.begin(slice) + TrainerId();
             p < local_vocab.end(slice); p += TrainerCount())
         {
-            int word = *p;
-            Row<int32_t>& row = GetRow<int32_t>(kWordTopicTable, word);
+            int32_t word = *p;
+            if (!exporter_->IsExported(word, block))
+            {
+                continue;
+            }
+            Row<int32_t>& row = model_->GetWordTopicRow(word);
             Row<int32_t>::iterator iter = row.Iterator();
-
-            fout << word;
+            entries.clear();
             while (iter.HasNext())
             {
-                int32_t topic = iter.Key();
-                int32_t count = iter.Value();
-                fout << " " << topic << ":" << count;
+                if (iter.Value() != 0)
+                {
+                    entries.push_back(std::make_pair(iter.Key(), iter.Value()));
+                }
                 iter.Next();
             }
-            fout << std::endl;
+            std::sort(entries.begin(), entries.end());
+            rows.words.push_back(word);
+            rows.sizes.push_back(static_cast<int32_t>(entries.size()));
+            for (auto& entry : entries)
+            {
+                rows.topics.push_back(entry.first);
+                rows.counts.push_back(entry.second);
+            }
         }
+        exporter_->AddRows(rows);
+        if (TrainerId() == 0)
+        {
+            Row<int64_t>& summary_row = model_->GetSummaryRow();
+            std::vector<int64_t> summary(Config::num_topics);
+            for (int32_t k = 0; k < Config::num_topics; ++k)
+            {
+                summary[k] = summary_row.At(k);
+            }
+            exporter_->SetSummary(summary);
+        }
+    }
 
-        fout.close();
+    xorshift_rng& Trainer::rng()
+    {
+        return sampler_->rng();
     }
 
     void ParamLoader::ParseAndRequest(DataBlockBase* data_block)
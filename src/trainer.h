@@ -14,16 +14,20 @@
 namespace multiverso { namespace lightlda
 {
     class AliasTable;
+    class DocScheduler;
     class LDADataBlock;
     class LightDocSampler;
     class Meta;
+    class ModelExport;
     class PSModel;
+    class xorshift_rng;
 
     /*! \brief Trainer is responsible for training a data block */
     class Trainer : public TrainerBase
     {
     public:
-        Trainer(AliasTable* alias, Barrier* barrier, Meta* meta);
+        Trainer(AliasTable* alias, Barrier* barrier, Meta* meta,
+            DocScheduler* scheduler, ModelExport* exporter);
         ~Trainer();
         /*!
          * \brief Defines Trainning method for a data_block in one iteration
@@ -36,7 +40,10 @@ namespace multiverso { namespace lightlda
          */
         void Evaluate(LDADataBlock* block);
 
-        void Dump(int32_t iter, LDADataBlock* lda_data_block);
+        /*! \brief Copies the rows of this trainer's words to the export */
+        void Export(LDADataBlock* block);
+        /*! \brief Gets the random number generator of the sampler */
+        xorshift_rng& rng();
 
     private:
         /*! \brief alias table, for alias access */
@@ -47,8 +54,12 @@ namespace multiverso { namespace lightlda
         Barrier* barrier_;
         /*! \brief meta information */
         Meta* meta_;
+        /*! \brief scheduler of documents to trainers, shared by trainers */
+        DocScheduler* scheduler_;
         /*! \brief model acceccor */
         PSModel * model_;
+        /*! \brief model export, nullptr if not enabled */
+        ModelExport* exporter_;
         static std::mutex mutex_;
 
         static double doc_llh_;
@@ -0,0 +1,121 @@
+#include "util.h"
+
+#include <multiverso/log.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <Windows.h>
+#else 
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace multiverso { namespace lightlda
+{
+    MappedFile::MappedFile() : data_(nullptr), size_(0)
+#if defined(_WIN32) || defined(_WIN64)
+        , file_(INVALID_HANDLE_VALUE), mapping_(nullptr)
+#endif
+    {}
+
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+    bool MappedFile::Open(const std::string& file_name)
+    {
+        Close();
+#if defined(_WIN32) || defined(_WIN64)
+        file_ = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ,
+            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        LARGE_INTEGER size;
+        if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size))
+        {
+            Close();
+            return false;
+        }
+        size_ = size.QuadPart;
+        if (size_ == 0)
+        {
+            return true;
+        }
+        mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping_ != nullptr)
+        {
+            data_ = static_cast<const char*>(
+                MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        }
+#else 
+        int fd = open(file_name.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd == -1 || fstat(fd, &info) != 0)
+        {
+            if (fd != -1) close(fd);
+            return false;
+        }
+        size_ = info.st_size;
+        if (size_ == 0)
+        {
+            close(fd);
+            return true;
+        }
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        data_ = (data == MAP_FAILED) ? nullptr : static_cast<const char*>(data);
+#endif
+        if (data_ == nullptr)
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+#if defined(_WIN32) || defined(_WIN64)
+        if (data_ != nullptr) UnmapViewOfFile(data_);
+        if (mapping_ != nullptr) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else 
+        if (data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    void AtomicMoveFile(const std::string& existing_file, 
+        const std::string& new_file)
+    {
+#if defined(_WIN32) || defined(_WIN64)
+        MoveFileExA(existing_file.c_str(), new_file.c_str(),
+            MOVEFILE_REPLACE_EXISTING);
+#else 
+        if (rename(existing_file.c_str(), new_file.c_str()) == -1)
+        {
+            multiverso::Log::Error("Failed to move tmp file to final location\n");
+        }
+#endif
+    }
+
+    bool MakeDirectory(const std::string& path)
+    {
+#if defined(_WIN32) || defined(_WIN64)
+        return CreateDirectoryA(path.c_str(), NULL) != 0 ||
+            GetLastError() == ERROR_ALREADY_EXISTS;
+#else 
+        struct stat info;
+        if (stat(path.c_str(), &info) == 0)
+        {
+            return S_ISDIR(info.st_mode);
+        }
+        return mkdir(path.c_str(), 0755) == 0;
+#endif
+    }
+} // namespace lightlda
+} // namespace multiverso
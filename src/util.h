@@ -1,12 +1,17 @@
 /*!
  * \file util.h
- * \brief Defines random number generator
+ * \brief Defines random number generator and file utilities
  */
 
 #ifndef LIGHTLDA_UTIL_H_
 #define LIGHTLDA_UTIL_H_
 
+#include <atomic>
+#include <cstdint>
 #include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace multiverso { namespace lightlda
 {
@@ -35,6 +40,10 @@ namespace multiverso { namespace lightlda
         {
             return static_cast<int>(rand() * 4.6566125e-10 * K);
         }
+        /*! \brief get the generator state, for checkpoint */
+        uint32_t state() const { return jxr_; }
+        /*! \brief set the generator state, for resume */
+        void set_state(uint32_t state) { jxr_ = state; }
     private:
         // No copying allowed
         xorshift_rng(const xorshift_rng &other);
@@ -42,6 +51,61 @@ namespace multiverso { namespace lightlda
         /*! \brief seed */
         uint32_t jxr_;
     };
+
+    /*! \brief MappedFile maps a whole file read-only into memory */
+    class MappedFile
+    {
+    public:
+        MappedFile();
+        ~MappedFile();
+        /*! \brief Maps a file, return false if it can not be mapped */
+        bool Open(const std::string& file_name);
+        /*! \brief Unmaps the file */
+        void Close();
+        const char* data() const { return data_; }
+        int64_t size() const { return size_; }
+    private:
+        const char* data_;
+        int64_t size_;
+#if defined(_WIN32) || defined(_WIN64)
+        void* file_;
+        void* mapping_;
+#endif
+        // No copying allowed
+        MappedFile(const MappedFile&);
+        void operator=(const MappedFile&);
+    };
+
+    /*! \brief Moves a file, replacing the destination if it exists */
+    void AtomicMoveFile(const std::string& existing_file,
+        const std::string& new_file);
+    /*! \brief Creates a directory, return true if it exists afterwards */
+    bool MakeDirectory(const std::string& path);
+
+    /*! \brief Calls func(i) for i in [0, num_tasks) on num_threads threads */
+    template <typename Func>
+    void ParallelFor(int32_t num_tasks, int32_t num_threads, Func func)
+    {
+        std::atomic<int32_t> next_task(0);
+        auto worker = [&]()
+        {
+            int32_t i;
+            while ((i = next_task++) < num_tasks)
+            {
+                func(i);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int32_t i = 1; i < num_threads; ++i)
+        {
+            threads.push_back(std::thread(worker));
+        }
+        worker();
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
 } // namespace lightlda
 } // namespace multiverso
 